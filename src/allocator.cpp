@@ -1,4 +1,43 @@
 #include "allocator.h"
+#include "settings.h"
+#include <algorithm>
+
+Default_Allocator default_allocator;
+Allocator *global_default_allocator = &default_allocator;
+thread_local Allocator *global_allocator = &default_allocator;
+
+thread_local Arena_Allocator thread_arena_allocator;
+thread_local Arena_Allocator *global_arena_allocator = nullptr;
+
+// the counters of the arenas of the finished threads
+Arena_Stats finished_arena_stats;
+Spin_Lock finished_arena_lock;
+
+void init_thread_allocators() {
+    global_allocator = global_default_allocator;
+    // Always created since Mcts_Config::arena_allocator can be changed at runtime,
+    // it doesn't allocate before it's used.
+    thread_arena_allocator = make_arena_allocator(global_default_allocator, ARENA_CHUNK_SIZE, ARENA_RELEASE_SIZE);
+    global_arena_allocator = &thread_arena_allocator;
+}
+void destroy_thread_allocators() {
+    if(global_arena_allocator) {
+        finished_arena_lock.lock();
+        finished_arena_stats.add(global_arena_allocator->get_stats());
+        finished_arena_lock.unlock();
+        global_arena_allocator->destroy();
+        global_arena_allocator = nullptr;
+    }
+}
+Arena_Stats get_arena_stats() {
+    finished_arena_lock.lock();
+    Arena_Stats result = finished_arena_stats;
+    finished_arena_lock.unlock();
+    if(global_arena_allocator) {
+        result.add(global_arena_allocator->get_stats());
+    }
+    return result;
+}
 void *Allocator::_alloc(isize) {return nullptr;}
 void *Allocator::_realloc(void *, isize) {return nullptr;}
 void Allocator::_free(void *) {}
@@ -10,88 +49,128 @@ const isize SIZE_OFFSET = sizeof(usize);
 usize mem_align(usize data) {
     return (data + (SIZE_OFFSET-1)) & -SIZE_OFFSET;
 }
-Arena_Bucket make_arena_bucket(isize count, Allocator *allocator) {
-    Arena_Bucket b = {};
-    b.data = allocator->_alloc(count);
-    return b;
-}
-
-isize Arena_Bucket::available(isize bucket_size) {
-    return bucket_size - point;
-}
-void *Arena_Bucket::request(isize count, isize bucket_size) {
-    isize total_count = count + SIZE_OFFSET;
-    isize c = available(bucket_size);
-    assert(point<=bucket_size);
-    if(c-total_count>=0) {
-        assert(c>=0);
-        u8 *p = (u8 *)data;
-        usize *d = (usize *)(p+point);
-        *d = count;
-        auto curr = point + SIZE_OFFSET;
-        point += total_count;            
-        return p+curr;
-    } else {
-        return nullptr;
-    }
-}
-Arena_Allocator make_arena_allocator(Allocator *allocator, isize bucket_size, isize bucket_count) {    
+Arena_Allocator make_arena_allocator(Allocator *allocator, isize chunk_size, isize release_size) {    
     Arena_Allocator a = {};
-    a.bucket_size = bucket_size;
-    a.data.resize(bucket_count);
     a.allocator = allocator;
-    for_range(i, 0, bucket_count) {
-        a.data[i] = make_arena_bucket(bucket_size, allocator);
-    }
+    a.chunk_size = chunk_size;
+    a.release_size = release_size;
     return a;
 }
+// Makes the next chunk with room for total bytes the current one, the rest of the current one is skipped
+void Arena_Allocator::next_chunk(isize total) {
+    in_use += end - point;
+    Arena_Chunk **link = current ? &current->next : &chunks;
+    if(!*link || (*link)->capacity < total) {
+        isize capacity = max(chunk_size, total);
+        auto chunk = (Arena_Chunk *)allocator->_alloc(sizeof(Arena_Chunk) + capacity);
+        release_assert(chunk, "arena out of memory");
+        chunk->next = *link;
+        chunk->capacity = capacity;
+        *link = chunk;
+        reserved += sizeof(Arena_Chunk) + capacity;
+        stats.reserved = max<i64>(stats.reserved, reserved);
+    }
+    current = *link;
+    point = (u8 *)(current + 1);
+    end = point + current->capacity;
+}
 void *Arena_Allocator::_alloc(isize count) {
     count = mem_align(count);
-    void *ptr = nullptr;
-    while(point<data.count) {
-        ptr = data[point].request(count, bucket_size);
-        if(ptr) break;
-        point += 1;
-    }
-    if(ptr) {
-        return ptr;
+    isize total = count + SIZE_OFFSET;
+    if(end - point < total) {
+        next_chunk(total);
     }
-    // make a new bucket
-    data.add(make_arena_bucket(bucket_size, allocator));
-    ptr = data[data.count-1].request(count, bucket_size);
-    assert(ptr);
-    // __builtin_assume_aligned ;
-    return ptr;
+    *(usize *)point = count;
+    last = point + SIZE_OFFSET;
+    point += total;
+    in_use += total;
+    stats.alloc_count += 1;
+    stats.bytes += count;
+    return last;
 }
 void *Arena_Allocator::_realloc(void *ptr, isize count) {
     if(ptr == nullptr) {
         return this->_alloc(count);
     }
-    usize *size_ptr = (usize *)((u8 *)ptr - SIZE_OFFSET);        
-    isize size = *size_ptr;
+    isize size = ptr_len(ptr);
     assert(size > 0);
+    if(ptr == last) {
+        isize resized = mem_align(count);
+        if(end - (u8 *)ptr >= resized) {
+            *(usize *)((u8 *)ptr - SIZE_OFFSET) = resized;
+            point = (u8 *)ptr + resized;
+            in_use += resized - size;
+            stats.alloc_count += 1;
+            stats.in_place_count += 1;
+            stats.bytes += max<isize>(resized - size, 0);
+            return ptr;
+        }
+    }
+    if(count <= size) {
+        return ptr;
+    }
     auto a = this->_alloc(count);        
     memcpy(a, ptr, size);
     return a;
 }
 void Arena_Allocator::_free(void *) {}
 void Arena_Allocator::clear_arena() {
-    
-    this->point = 0;
-    // data.count is always 1 so the whole resetting is O(1)
-    for_range(i, 0, data.count) {
-        data[i].point = 0;
+    stats.reset_count += 1;
+    stats.high_water = max<i64>(stats.high_water, in_use);
+    in_use = 0;
+    last = nullptr;
+    if(release_size > 0 && reserved > release_size && chunks) {
+        // the first chunk is always kept
+        isize kept = sizeof(Arena_Chunk) + chunks->capacity;
+        Arena_Chunk *keep = chunks;
+        while(keep->next && kept + isize(sizeof(Arena_Chunk)) + keep->next->capacity <= release_size) {
+            keep = keep->next;
+            kept += sizeof(Arena_Chunk) + keep->capacity;
+        }
+        for(auto chunk = keep->next; chunk;) {
+            auto next = chunk->next;
+            stats.released += sizeof(Arena_Chunk) + chunk->capacity;
+            allocator->_free(chunk);
+            chunk = next;
+        }
+        keep->next = nullptr;
+        reserved = kept;
+    }
+    current = chunks;
+    if(current) {
+        point = (u8 *)(current + 1);
+        end = point + current->capacity;
     }
 }
 void Arena_Allocator::destroy() {
-    for_range(i, 0, data.count) {
-        allocator->_free(data[i].data);
+    for(auto chunk = chunks; chunk;) {
+        auto next = chunk->next;
+        allocator->_free(chunk);
+        chunk = next;
     }
-    data.destroy();
+    *this = make_arena_allocator(allocator, chunk_size, release_size);
 }
 usize Arena_Allocator::ptr_len(void *ptr) {
     return *(usize *)((u8 *)ptr - SIZE_OFFSET);
 }
+Arena_Stats Arena_Allocator::get_stats() {
+    Arena_Stats result = stats;
+    result.high_water = max<i64>(result.high_water, in_use);
+    return result;
+}
+void Arena_Stats::add(const Arena_Stats &other) {
+    alloc_count += other.alloc_count;
+    in_place_count += other.in_place_count;
+    bytes += other.bytes;
+    reset_count += other.reset_count;
+    high_water = max(high_water, other.high_water);
+    reserved += other.reserved;
+    released += other.released;
+}
+void print_arena_stats(const Arena_Stats &s) {
+    println("arena allocations:", s.alloc_count, "| in place reallocs:", s.in_place_count, "| MB:", f64(s.bytes)/1e6, "| resets:", s.reset_count);
+    println("arena high water KB:", f64(s.high_water)/1e3, "| reserved KB:", f64(s.reserved)/1e3, "| released KB:", f64(s.released)/1e3);
+}
 
 void *Default_Allocator::_alloc(isize count) {
     return ::malloc(count);
@@ -102,3 +181,256 @@ void *Default_Allocator::_realloc(void *ptr, isize count) {
 void Default_Allocator::_free(void *ptr) {
     ::free(ptr);
 }
+
+Pool_Allocator make_pool_allocator(Allocator *allocator, isize chunk_size) {
+    Pool_Allocator p = {};
+    p.allocator = allocator;
+    p.chunk_size = chunk_size;
+    return p;
+}
+// 4 classes per power of 2 so that a node wastes at most a fifth of its block
+inline isize pool_class_size(isize size_class) {
+    return (4 + (size_class & 3)) << ((size_class >> 2) + 2);
+}
+// smallest class with pool_class_size(size_class) >= size
+inline isize pool_size_class(isize size) {
+    if(size <= 16) {
+        return 0;
+    }
+    // size is in ]2^(shift+2), 2^(shift+3)] and the classes in there are (5, 6, 7, 8) << shift
+    isize shift = log2_floor(size - 1) - 2;
+    isize steps = ((size - 1) >> shift) + 1;
+    return 4*(shift - 2) + (steps - 4);
+}
+Pool_Chunk *Pool_Allocator::new_chunk(isize count) {
+    auto chunk = (Pool_Chunk *)allocator->_alloc(sizeof(Pool_Chunk) + count);
+    release_assert(chunk, "pool out of memory");
+    chunk->next = chunks;
+    chunk->size = count;
+    chunk->used = 0;
+    chunks = chunk;
+    reserved += sizeof(Pool_Chunk) + count;
+    return chunk;
+}
+void *Pool_Allocator::_alloc(isize count) {
+    isize total = mem_align(count) + sizeof(Pool_Block_Header);
+    isize size_class = min<isize>(pool_size_class(total), POOL_CLASS_COUNT);
+    if(thread_safe) lock.lock();
+    Pool_Block_Header *block;
+    if(size_class == POOL_CLASS_COUNT) {
+        auto chunk = new_chunk(total);
+        chunk->used = -1;
+        block = (Pool_Block_Header *)(chunk + 1);
+        block->capacity = total - sizeof(Pool_Block_Header);
+        in_use += total;
+    } else {
+        isize size = pool_class_size(size_class);
+        if(free_lists[size_class]) {
+            block = (Pool_Block_Header *)free_lists[size_class];
+            // the next pointer is stored behind the header
+            free_lists[size_class] = *(void **)(block + 1);
+        } else if(available < size && reserve_limit > 0 && reserved + isize(sizeof(Pool_Chunk)) + chunk_size > reserve_limit
+            && (block = split_free_block(size_class))) {
+            // A block of a bigger class keeps the capacity and the use of the asked one, in_use
+            // has to be the same for a tree whatever the free lists hold (see mcts_memory.cpp).
+            size_class = block->size_class;
+        } else {
+            // the rest of the current chunk is simply lost
+            if(available < size) {
+                current = new_chunk(chunk_size);
+                point = (u8 *)(current + 1);
+                available = chunk_size;
+            }
+            block = (Pool_Block_Header *)point;
+            point += size;
+            available -= size;
+            current->used += size;
+        }
+        block->capacity = size - sizeof(Pool_Block_Header);
+        in_use += size;
+    }
+    block->size_class = size_class;
+    if(thread_safe) lock.unlock();
+    return block + 1;
+}
+Pool_Block_Header *Pool_Allocator::split_free_block(isize size_class) {
+    isize bigger = size_class + 1;
+    while(bigger < POOL_CLASS_COUNT && !free_lists[bigger]) {
+        bigger += 1;
+    }
+    if(bigger == POOL_CLASS_COUNT) {
+        return nullptr;
+    }
+    auto block = (Pool_Block_Header *)free_lists[bigger];
+    free_lists[bigger] = *(void **)(block + 1);
+    // Every class size is a multiple of 4 and every multiple of 4 from 16 to 28 is one,
+    // so a rest of at least 16 bytes goes into the free lists without a loss.
+    // A smaller one stays part of the block.
+    isize rest = pool_class_size(bigger) - pool_class_size(size_class);
+    if(rest < 16) {
+        block->size_class = u32(bigger);
+        return block;
+    }
+    block->size_class = u32(size_class);
+    u8 *point = (u8 *)block + pool_class_size(size_class);
+    while(rest > 0) {
+        isize c = pool_size_class(rest);
+        if(pool_class_size(c) != rest) {
+            // the biggest class that leaves at least 16 bytes
+            c = pool_size_class(rest - 16);
+            if(pool_class_size(c) > rest - 16) c -= 1;
+        }
+        auto piece = (Pool_Block_Header *)point;
+        piece->size_class = u32(c);
+        *(void **)(piece + 1) = free_lists[c];
+        free_lists[c] = piece;
+        point += pool_class_size(c);
+        rest -= pool_class_size(c);
+    }
+    return block;
+}
+void *Pool_Allocator::_realloc(void *ptr, isize count) {
+    if(ptr == nullptr) {
+        return this->_alloc(count);
+    }
+    auto block = (Pool_Block_Header *)ptr - 1;
+    if(count <= block->capacity) {
+        return ptr;
+    }
+    auto a = this->_alloc(count);
+    memcpy(a, ptr, block->capacity);
+    this->_free(ptr);
+    return a;
+}
+void Pool_Allocator::_free(void *ptr) {
+    if(ptr == nullptr) {
+        return;
+    }
+    auto block = (Pool_Block_Header *)ptr - 1;
+    if(thread_safe) lock.lock();
+    if(block->size_class == POOL_CLASS_COUNT) {
+        in_use -= sizeof(Pool_Block_Header) + block->capacity;
+        // a big block of a loaded checkpoint (see adopt) isn't in a chunk
+        for(Pool_Chunk **it = &chunks; *it; it = &(*it)->next) {
+            if(*it + 1 == (Pool_Chunk *)block) {
+                Pool_Chunk *chunk = *it;
+                *it = chunk->next;
+                reserved -= sizeof(Pool_Chunk) + chunk->size;
+                allocator->_free(chunk);
+                break;
+            }
+        }
+        if(thread_safe) lock.unlock();
+        return;
+    }
+    *(void **)ptr = free_lists[block->size_class];
+    free_lists[block->size_class] = block;
+    in_use -= sizeof(Pool_Block_Header) + block->capacity;
+    if(thread_safe) lock.unlock();
+}
+isize Pool_Allocator::release_free_chunks() {
+    if(thread_safe) lock.lock();
+    // the chunks blocks are cut out of by their address, with the bytes of their free blocks
+    struct Chunk_Use {
+        Pool_Chunk *chunk;
+        isize free;
+    };
+    isize count = 0;
+    for(auto chunk = chunks; chunk; chunk = chunk->next) {
+        count += chunk->used > 0 && chunk != current;
+    }
+    auto uses = (Chunk_Use *)allocator->_alloc(max<isize>(count, 1) * sizeof(Chunk_Use));
+    release_assert(uses, "pool out of memory");
+    isize n = 0;
+    for(auto chunk = chunks; chunk; chunk = chunk->next) {
+        if(chunk->used > 0 && chunk != current) {
+            uses[n] = {chunk, 0};
+            n += 1;
+        }
+    }
+    std::sort(uses, uses + n, [](const Chunk_Use &a, const Chunk_Use &b) {
+        return a.chunk < b.chunk;
+    });
+    // the use of the chunk of a free block, nullptr if it isn't in one of them (current, adopt)
+    auto find = [&](void *block) -> Chunk_Use * {
+        isize low = 0, high = n;
+        while(low < high) {
+            isize mid = (low + high) / 2;
+            if((u8 *)uses[mid].chunk < (u8 *)block) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        if(low == 0) return nullptr;
+        auto &use = uses[low - 1];
+        return (u8 *)block < (u8 *)(use.chunk + 1) + use.chunk->size ? &use : nullptr;
+    };
+    auto releasable = [](Chunk_Use *use) {
+        return use && use->free == use->chunk->used;
+    };
+    // the next pointer of a free block is stored behind the header
+    for_range(c, 0, POOL_CLASS_COUNT) {
+        for(void *block = free_lists[c]; block; block = *(void **)((Pool_Block_Header *)block + 1)) {
+            if(auto use = find(block)) {
+                use->free += pool_class_size(c);
+            }
+        }
+    }
+    // the free lists without the blocks of the released chunks
+    for_range(c, 0, POOL_CLASS_COUNT) {
+        void **last = &free_lists[c];
+        for(void *block = free_lists[c]; block;) {
+            void *next = *(void **)((Pool_Block_Header *)block + 1);
+            if(!releasable(find(block))) {
+                *last = block;
+                last = (void **)((Pool_Block_Header *)block + 1);
+            }
+            block = next;
+        }
+        *last = nullptr;
+    }
+    isize released = 0;
+    for(Pool_Chunk **it = &chunks; *it;) {
+        Pool_Chunk *chunk = *it;
+        if(chunk->used > 0 && chunk != current && releasable(find(chunk + 1))) {
+            *it = chunk->next;
+            released += sizeof(Pool_Chunk) + chunk->size;
+            allocator->_free(chunk);
+        } else {
+            it = &chunk->next;
+        }
+    }
+    reserved -= released;
+    allocator->_free(uses);
+    if(thread_safe) lock.unlock();
+    return released;
+}
+Pool_Block_Header pool_block_header(isize count) {
+    isize total = mem_align(count) + sizeof(Pool_Block_Header);
+    isize size_class = min<isize>(pool_size_class(total), POOL_CLASS_COUNT);
+    Pool_Block_Header header;
+    header.size_class = u32(size_class);
+    if(size_class == POOL_CLASS_COUNT) {
+        header.capacity = u32(total - sizeof(Pool_Block_Header));
+    } else {
+        header.capacity = u32(pool_class_size(size_class) - sizeof(Pool_Block_Header));
+    }
+    return header;
+}
+void *Pool_Allocator::adopt(void *memory, isize count) {
+    auto block = (Pool_Block_Header *)memory;
+    *block = pool_block_header(count);
+    if(thread_safe) lock.lock();
+    in_use += sizeof(Pool_Block_Header) + block->capacity;
+    if(thread_safe) lock.unlock();
+    return block + 1;
+}
+void Pool_Allocator::destroy() {
+    for(auto chunk = chunks; chunk;) {
+        auto next = chunk->next;
+        allocator->_free(chunk);
+        chunk = next;
+    }
+    *this = make_pool_allocator(allocator, chunk_size);
+}
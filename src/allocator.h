@@ -1,37 +1,130 @@
 #ifndef ALLOCATOR_H
 #define ALLOCATOR_H
-#define ALLOCATOR_BUCKET_SIZE 10
 #include "util.h"
 
-
+#define ARENA_CHUNK_SIZE (1 << 20)
+// clear_arena of the thread arenas gives back the chunks beyond this size
+#define ARENA_RELEASE_SIZE (4 * ARENA_CHUNK_SIZE)
 
 usize mem_align(usize);
 
-struct Arena_Bucket {
-    isize point = 0;
-    void *data = nullptr;
-    isize available(isize);
-    void *request(isize, isize);
+struct Arena_Chunk {
+    Arena_Chunk *next;
+    isize capacity; // bytes behind the chunk
 };
-
+// Counters of arenas, see get_arena_stats
+struct Arena_Stats {
+    i64 alloc_count = 0;    // _alloc and _realloc calls
+    i64 in_place_count = 0; // _realloc calls which resized the last allocation in place
+    i64 bytes = 0;          // requested by the allocations
+    i64 reset_count = 0;    // clear_arena calls
+    i64 high_water = 0;     // most bytes in use between two resets (sizes, alignment and skipped chunk ends)
+    i64 reserved = 0;       // most bytes of chunks at once
+    i64 released = 0;       // bytes of the chunks clear_arena gave back
+    // counts are summed up, high_water is the maximum
+    void add(const Arena_Stats &);
+};
+/*
+    Bump allocator over a chain of chunks which are allocated when they are needed first.
+    Every allocation is preceded by its size (see ptr_len). An allocation that doesn't fit into
+    the rest of the current chunk goes to the next one, bigger ones get their own chunk.
+    clear_arena starts over at the first chunk; with a release_size the chunks beyond it are freed.
+    _realloc of the last allocation resizes it in place if the chunk has room for it.
+*/
 struct Arena_Allocator : Allocator {
-    Array<Arena_Bucket> data;
-    Allocator *allocator; // the underlying allocator (malloc)
-    isize point = 0;
-    isize bucket_size;
+    Arena_Chunk *chunks = nullptr;
+    Arena_Chunk *current = nullptr;
+    u8 *point = nullptr;
+    u8 *end = nullptr;
+    void *last = nullptr; // the most recent allocation
+    isize in_use = 0;     // bytes since the last clear_arena
+    Allocator *allocator = nullptr; // the underlying allocator (malloc)
+    isize chunk_size = 0;
+    isize release_size = 0; // 0: the chunks are kept until destroy
+    isize reserved = 0;
+    Arena_Stats stats;
     void *_alloc(isize) override;
     void *_realloc(void *, isize) override;
     void _free(void *) override;
+    void next_chunk(isize);
     void clear_arena();
     void destroy();
     usize ptr_len(void *);
+    Arena_Stats get_stats();
 };
 struct Default_Allocator : Allocator {
     void *_alloc(isize) override;
     void *_realloc(void *, isize) override;
     void _free(void *) override;
 };
-Arena_Allocator make_arena_allocator(Allocator *, isize = 10000000, isize = 1);
+Arena_Allocator make_arena_allocator(Allocator *, isize chunk_size = ARENA_CHUNK_SIZE, isize release_size = 0);
+
+// size classes of the pool: 16, 20, 24, 28, 32, 40, ..., 7168, 8192 bytes (header included)
+#define POOL_CLASS_COUNT 37
+#define POOL_CHUNK_SIZE (1 << 20)
+
+struct Pool_Chunk {
+    Pool_Chunk *next;
+    isize size; // bytes behind the header
+    isize used; // bytes cut into blocks, -1 for the chunk of a big block
+};
+struct Pool_Block_Header {
+    u32 size_class;
+    u32 capacity;
+};
+/*
+    Pool for the nodes of a tree and their arrays (see Mcts::node_allocator).
+    Blocks are cut out of big chunks and freed blocks go into a free list of their size class.
+    Blocks bigger than the biggest class get their own chunk which is given back when the block is freed.
+    Freed blocks are reused by the next blocks of their class, in_use is what a tree needs at the moment
+    and reserved what it takes from the process. release_free_chunks gives back the chunks
+    whose blocks are all free (see prune_tree).
+    destroy frees the whole tree with one call to the underlying allocator per chunk.
+*/
+struct Pool_Allocator : Allocator {
+    void *free_lists[POOL_CLASS_COUNT] = {};
+    Pool_Chunk *chunks = nullptr;
+    Pool_Chunk *current = nullptr; // the chunk of point
+    u8 *point = nullptr;
+    isize available = 0;
+    Allocator *allocator = nullptr; // the underlying allocator (malloc)
+    isize chunk_size = 0;
+    isize reserved = 0; // bytes requested from the underlying allocator
+    isize in_use = 0;   // bytes of the blocks which haven't been freed (headers included)
+    // 0: no limit. Above it a new block is split off a free block of a bigger class
+    // before the pool takes another chunk (see prune_tree).
+    isize reserve_limit = 0;
+    // has to be set if multiple threads share the pool (tree parallelization)
+    bool thread_safe = false;
+    Spin_Lock lock;
+    void *_alloc(isize) override;
+    void *_realloc(void *, isize) override;
+    void _free(void *) override;
+    Pool_Chunk *new_chunk(isize);
+    // A block of size_class split off the smallest free block of a bigger class, the rest goes
+    // into the free lists. nullptr if there is none.
+    Pool_Block_Header *split_free_block(isize size_class);
+    // Gives the chunks back to the underlying allocator which only have free blocks
+    // (the current one stays), returns the bytes
+    isize release_free_chunks();
+    // Makes memory a block of the pool as if _alloc(count) had returned it, returns its data.
+    // memory has room for the header and the capacity of pool_block_header(count) and
+    // stays valid until destroy (see load_mcts_checkpoint).
+    void *adopt(void *memory, isize count);
+    void destroy();
+};
+// The header of the block _alloc(count) returns
+Pool_Block_Header pool_block_header(isize count);
+Pool_Allocator make_pool_allocator(Allocator *, isize = POOL_CHUNK_SIZE);
+
+// Creates the arena of the calling thread and sets global_allocator to malloc.
+// Has to be called once at the start of every thread that runs a search.
+void init_thread_allocators();
+// Frees the arena of the calling thread, its counters go to get_arena_stats
+void destroy_thread_allocators();
+// The counters of the arenas of the finished threads and the one of the calling thread
+Arena_Stats get_arena_stats();
+void print_arena_stats(const Arena_Stats &);
 
 bool test_allocator();
 
@@ -7,6 +7,7 @@
 
 #include "sokoban.h"
 #include "util.h"
+#include "level_corpus.h"
 
 struct Game;
 struct Level_Set;
@@ -219,7 +220,7 @@ Array<Grid> parse_file_data(const char *file_name, isize count = -1) {
 				auto pawn_id = char_to_pawn_id[c];
 				assert(pawn_id>=0);
 				Pawn pawn = Pawn(pawn_id);
-				grid(x, y) = pawn;
+				grid.set(x, y, pawn);
 				reader.next();
 			}
 		}
@@ -274,6 +275,19 @@ Array<Grid> parse_file_data(const char *file_name, isize count = -1) {
 void make_level_set_from(Game &game, String file_name) {
 	println("loading" ,file_name);
 	auto name = concat("saved_levels/", file_name);
+	// a corpus has the scores as well
+	if(is_corpus_path(name.data)) {
+		Level_Corpus corpus;
+		if(open_level_corpus(&corpus, name.data)) {
+			for_range(i, 0, corpus.count) {
+				game.level_set.data.add(corpus.get(i));
+			}
+			game.level_set.point = 0;
+			close_level_corpus(&corpus);
+		}
+		name.destroy();
+		return;
+	}
 	auto grids = parse_file_data(name.data);
 	for_range(i, 0, grids.count) {
 		game.level_set.add_simple(grids[i]);
@@ -70,12 +70,20 @@ struct Allocator {
 };
 struct Arena_Allocator;
 
-// Current allocator in use
-extern Allocator *global_allocator;
-// malloc
+// Current allocator of the calling thread; see set_allocator.
+// Every thread starts with global_default_allocator.
+extern thread_local Allocator *global_allocator;
+// malloc; shared by all threads
 extern Allocator *global_default_allocator;
-// allocator.h
-extern Arena_Allocator *global_arena_allocator;
+// Arena of the calling thread; see init_thread_allocators (allocator.h)
+extern thread_local Arena_Allocator *global_arena_allocator;
+
+// Sets the allocator of the calling thread and returns the previous one
+inline Allocator *set_allocator(Allocator *allocator) {
+	Allocator *previous = global_allocator;
+	global_allocator = allocator;
+	return previous;
+}
 
 inline void *mem_alloc(isize count, isize size) {
 	assert(count >= 0);
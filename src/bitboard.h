@@ -0,0 +1,229 @@
+#ifndef BITBOARD_H
+#define BITBOARD_H
+#include "sokoban.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+/*
+	Bitboards: one bit per cell, using the same index as the grid (y*width + x).
+	A board has at most 254 cells (see print_and_check_settings) so a plane always fits into 256 bits.
+
+	Moving a whole plane one step is a shift by 1 (left/right) or by width (up/down).
+	Cells which would leave the board through the left/right border are masked off with
+	Board_Shape::not_first_column/not_last_column, those below the last row with Board_Shape::inside.
+
+	The generator uses them for the first phase (see action_delete_obstacle/action_place_box).
+	The Grid stays the format of the GUI and the level files.
+*/
+struct Bits256 {
+	u64 w[4];
+
+	force_inline void set(isize index) {
+		w[index >> 6] |= u64(1) << (index & 63);
+	}
+	force_inline void reset(isize index) {
+		w[index >> 6] &= ~(u64(1) << (index & 63));
+	}
+	force_inline bool has(isize index) const {
+		return (w[index >> 6] >> (index & 63)) & 1;
+	}
+	force_inline bool is_empty() const {
+		return (w[0] | w[1] | w[2] | w[3]) == 0;
+	}
+	force_inline isize count() const {
+		return popcount(w[0]) + popcount(w[1]) + popcount(w[2]) + popcount(w[3]);
+	}
+};
+
+inline Bits256 operator&(const Bits256 &a, const Bits256 &b) {
+	return {{a.w[0] & b.w[0], a.w[1] & b.w[1], a.w[2] & b.w[2], a.w[3] & b.w[3]}};
+}
+inline Bits256 operator|(const Bits256 &a, const Bits256 &b) {
+	return {{a.w[0] | b.w[0], a.w[1] | b.w[1], a.w[2] | b.w[2], a.w[3] | b.w[3]}};
+}
+inline Bits256 operator^(const Bits256 &a, const Bits256 &b) {
+	return {{a.w[0] ^ b.w[0], a.w[1] ^ b.w[1], a.w[2] ^ b.w[2], a.w[3] ^ b.w[3]}};
+}
+inline bool operator==(const Bits256 &a, const Bits256 &b) {
+	return ((a.w[0] ^ b.w[0]) | (a.w[1] ^ b.w[1]) | (a.w[2] ^ b.w[2]) | (a.w[3] ^ b.w[3])) == 0;
+}
+inline bool operator!=(const Bits256 &a, const Bits256 &b) {
+	return !(a == b);
+}
+// a without b; there is no operator~ since it would set the bits outside of the board
+inline Bits256 andnot(const Bits256 &a, const Bits256 &b) {
+	return {{a.w[0] & ~b.w[0], a.w[1] & ~b.w[1], a.w[2] & ~b.w[2], a.w[3] & ~b.w[3]}};
+}
+
+// bit i -> bit i+n, 0 < n < 256
+inline Bits256 shift_to_higher(const Bits256 &a, i32 n) {
+	assert(n > 0 && n < 256);
+	Bits256 r = {};
+	i32 q = n >> 6;
+	i32 s = n & 63;
+	for(i32 i = 3; i >= q; i -= 1) {
+		u64 v = a.w[i-q] << s;
+		if(s != 0 && i-q-1 >= 0) {
+			v |= a.w[i-q-1] >> (64-s);
+		}
+		r.w[i] = v;
+	}
+	return r;
+}
+// bit i -> bit i-n, 0 < n < 256
+inline Bits256 shift_to_lower(const Bits256 &a, i32 n) {
+	assert(n > 0 && n < 256);
+	Bits256 r = {};
+	i32 q = n >> 6;
+	i32 s = n & 63;
+	for(i32 i = 0; i+q < 4; i += 1) {
+		u64 v = a.w[i+q] >> s;
+		if(s != 0 && i+q+1 < 4) {
+			v |= a.w[i+q+1] << (64-s);
+		}
+		r.w[i] = v;
+	}
+	return r;
+}
+
+// Bits start..start+length-1 set
+inline Bits256 make_bit_range(isize start, isize length) {
+	assert(start >= 0 && length >= 0 && start+length <= 256);
+	Bits256 r = {};
+	for_range(i, 0, 4) {
+		isize lo = max(start, isize(i)*64);
+		isize hi = min(start+length, isize(i+1)*64);
+		if(lo >= hi) continue;
+		isize n = hi - lo;
+		u64 bits = (n == 64) ? ~u64(0) : ((u64(1) << n) - 1);
+		r.w[i] = bits << (lo - i*64);
+	}
+	return r;
+}
+
+struct Board_Shape {
+	Bits256 inside;
+	Bits256 not_first_column;
+	Bits256 not_last_column;
+	i32 width;
+	i32 height;
+};
+
+inline Board_Shape make_board_shape(i32 width, i32 height) {
+	assert(width*height <= 256);
+	Board_Shape shape = {};
+	shape.width = width;
+	shape.height = height;
+	shape.inside = make_bit_range(0, width*height);
+	shape.not_first_column = shape.inside;
+	shape.not_last_column = shape.inside;
+	for_range(y, 0, height) {
+		shape.not_first_column.reset(y*width);
+		shape.not_last_column.reset(y*width + width-1);
+	}
+	return shape;
+}
+
+// Every cell of the plane takes one step; cells which would leave the board are dropped
+inline Bits256 shift_up(const Bits256 &a, const Board_Shape &shape) {
+	return shift_to_lower(a, shape.width);
+}
+inline Bits256 shift_down(const Bits256 &a, const Board_Shape &shape) {
+	return shift_to_higher(a, shape.width) & shape.inside;
+}
+inline Bits256 shift_left(const Bits256 &a, const Board_Shape &shape) {
+	return shift_to_lower(a & shape.not_first_column, 1);
+}
+inline Bits256 shift_right(const Bits256 &a, const Board_Shape &shape) {
+	return shift_to_higher(a & shape.not_last_column, 1);
+}
+// Cells with at least one (4-)neighbour in the plane
+inline Bits256 neighbours_of(const Bits256 &a, const Board_Shape &shape) {
+	return shift_up(a, shape) | shift_down(a, shape) | shift_left(a, shape) | shift_right(a, shape);
+}
+
+// The nodes only store as many words as the board needs, see Mcts_Node::block_set
+inline Bits256 load_bits(const Cell_Set &set) {
+	assert(set.word_count <= 4);
+	Bits256 r = {};
+	for_range(i, 0, set.word_count) {
+		r.w[i] = set.words[i];
+	}
+	return r;
+}
+inline void store_bits(Cell_Set set, const Bits256 &bits) {
+	assert(set.word_count <= 4);
+	for_range(i, 0, set.word_count) {
+		set.words[i] = bits.w[i];
+	}
+}
+
+// Cells of the grid whose pawn has any of the bits of mask, e.g. u8(Pawn::Collision)
+inline Bits256 grid_cells_with(const Grid &grid, u8 mask) {
+	Bits256 r = {};
+	isize count = grid.get_count();
+	assert(count <= 256);
+	#if defined(__SSE2__) || defined(_M_X64)
+	// 16 cells at once, the padding is zero and therefore never part of the result
+	alignas(16) u8 buffer[256] = {};
+	memcpy(buffer, grid.data, min<usize>(count, 256));
+	__m128i m = _mm_set1_epi8(char(mask));
+	__m128i zero = _mm_setzero_si128();
+	for(isize i = 0; i < count; i += 16) {
+		__m128i v = _mm_and_si128(_mm_load_si128((const __m128i *)(buffer + i)), m);
+		u64 bits = u64(~_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) & 0xffff);
+		r.w[i >> 6] |= bits << (i & 63);
+	}
+	#else
+	for_range(i, 0, count) {
+		if(u8(grid.data[i]) & mask) r.set(i);
+	}
+	#endif
+	return r;
+}
+
+struct Bitboard {
+	Bits256 block;
+	Bits256 box;
+	Bits256 goal;
+	Bits256 pusher;
+};
+
+inline Bitboard make_bitboard(const Grid &grid) {
+	Bitboard board;
+	board.block  = grid_cells_with(grid, u8(Pawn::Block));
+	board.box    = grid_cells_with(grid, u8(Pawn::Box));
+	board.goal   = grid_cells_with(grid, u8(Pawn::Goal));
+	board.pusher = grid_cells_with(grid, u8(Pawn::Pusher));
+	return board;
+}
+inline u64 zobrist_hash_of(const Bits256 &bits, const u64 *keys) {
+	u64 hash = 0;
+	for_range(i, 0, 4) {
+		for(u64 word = bits.w[i]; word; word &= word - 1) {
+			hash ^= keys[i*64 + count_trailing_zeros(word)];
+		}
+	}
+	return hash;
+}
+// Same as grid_hash of the grid of the board
+inline u64 bitboard_hash(const Bitboard &board) {
+	return zobrist_hash_of(board.block, ZOBRIST_KEYS.block) ^ zobrist_hash_of(board.box, ZOBRIST_KEYS.box)
+		 ^ zobrist_hash_of(board.goal, ZOBRIST_KEYS.goal) ^ zobrist_hash_of(board.pusher, ZOBRIST_KEYS.pusher);
+}
+// The grid has to have the size of the board
+inline void bitboard_to_grid(const Bitboard &board, Grid &grid) {
+	for_range(i, 0, grid.get_count()) {
+		u8 pawn = 0;
+		if(board.block.has(i))  pawn |= u8(Pawn::Block);
+		if(board.box.has(i))    pawn |= u8(Pawn::Box);
+		if(board.goal.has(i))   pawn |= u8(Pawn::Goal);
+		if(board.pusher.has(i)) pawn |= u8(Pawn::Pusher);
+		grid.data[i] = Pawn(pawn);
+	}
+	grid.hash = bitboard_hash(board);
+}
+
+#endif // BITBOARD_H
@@ -0,0 +1,177 @@
+#include "config.h"
+#include <inttypes.h>
+
+Mcts_Config default_mcts_config() {
+    Mcts_Config config = {};
+    config.size = Vector2i DEFAULT_BOARD_SIZE;
+    config.start_position = Vector2i DEFAULT_START_POSITION;
+    config.timeout = DEFAULT_TIMEOUT;
+    config.simulation_count = SIMULATION_COUNT;
+    config.depth_lower_cutoff = DEPTH_LOWER_CUTOFF;
+    config.box_lower_cutoff = BOX_LOWER_CUTOFF;
+    config.box_upper_cutoff = BOX_UPPER_CUTOFF;
+    config.remove_impossible = REMOVE_IMPOSSIBLE;
+    config.simple_moves = USE_SIMPLE_MOVES;
+    config.arena_allocator = ARENA_ALLOCATOR;
+    config.scratch_rollout = SCRATCH_ROLLOUT;
+    config.add_good_levels = ADD_GOOD_LEVELS;
+    config.good_level_cut = GOOD_LEVEL_CUT;
+    config.memory_budget = MEMORY_BUDGET;
+    config.decision = Decision_Kind::Ucb1_Tuned;
+    return config;
+}
+
+const char *DECISION_KIND_NAMES[] = {"ucb1", "ucb1-tuned", "ucb-v", "sp-mcts"};
+
+const char *decision_kind_name(Decision_Kind kind) {
+    return DECISION_KIND_NAMES[u8(kind)];
+}
+
+static bool parse_bool(const char *value, bool *result) {
+    String s = value;
+    if(s == String("1") || s == String("true")) {
+        *result = true;
+    } else if(s == String("0") || s == String("false")) {
+        *result = false;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool parse_mcts_config_arg(Mcts_Config *config, const char *name, const char *value) {
+    if(name[0] == '-' && name[1] == '-') {
+        name += 2;
+    }
+    String n = name;
+    auto &c = *config;
+    bool ok;
+    if(n == String("size")) {
+        ok = sscanf(value, "%dx%d", &c.size.x, &c.size.y) == 2;
+    } else if(n == String("start")) {
+        ok = sscanf(value, "%d,%d", &c.start_position.x, &c.start_position.y) == 2;
+    } else if(n == String("timeout")) {
+        ok = sscanf(value, "%lf", &c.timeout) == 1;
+    } else if(n == String("simulations")) {
+        ok = sscanf(value, "%" SCNd64, &c.simulation_count) == 1;
+    } else if(n == String("depth-cutoff")) {
+        ok = sscanf(value, "%d", &c.depth_lower_cutoff) == 1;
+    } else if(n == String("box-lower-cutoff")) {
+        ok = sscanf(value, "%d", &c.box_lower_cutoff) == 1;
+    } else if(n == String("box-upper-cutoff")) {
+        ok = sscanf(value, "%d", &c.box_upper_cutoff) == 1;
+    } else if(n == String("remove-impossible")) {
+        ok = parse_bool(value, &c.remove_impossible);
+    } else if(n == String("simple-moves")) {
+        ok = parse_bool(value, &c.simple_moves);
+    } else if(n == String("arena")) {
+        ok = parse_bool(value, &c.arena_allocator);
+    } else if(n == String("scratch-rollout")) {
+        ok = parse_bool(value, &c.scratch_rollout);
+    } else if(n == String("add-good-levels")) {
+        ok = parse_bool(value, &c.add_good_levels);
+    } else if(n == String("good-level-cut")) {
+        ok = sscanf(value, "%lf", &c.good_level_cut) == 1;
+    } else if(n == String("memory-budget")) {
+        ok = sscanf(value, "%lf", &c.memory_budget) == 1;
+    } else if(n == String("config")) {
+        return load_mcts_config(config, value);
+    } else if(n == String("decision")) {
+        ok = false;
+        for_range(i, 0, (isize)carray_len(DECISION_KIND_NAMES)) {
+            if(String(value) == String(DECISION_KIND_NAMES[i])) {
+                c.decision = Decision_Kind(i);
+                ok = true;
+            }
+        }
+    } else {
+        println("unknown setting", name);
+        return false;
+    }
+    if(!ok) {
+        println("bad value for", name, ":", value);
+    }
+    return ok;
+}
+
+bool parse_mcts_config_args(Mcts_Config *config, char **args, int count) {
+    for(int i = 0; i < count; i += 2) {
+        if(i+1 >= count) {
+            println("missing value for", args[i]);
+            return false;
+        }
+        if(!parse_mcts_config_arg(config, args[i], args[i+1])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool load_mcts_config(Mcts_Config *config, const char *path) {
+    FILE *file = fopen(path, "r");
+    if(!file) {
+        println("couldn't open", path);
+        return false;
+    }
+    char line[512];
+    bool ok = true;
+    while(ok && fgets(line, sizeof(line), file)) {
+        char *comment = strchr(line, '#');
+        if(comment) *comment = '\0';
+        char name[128], value[256];
+        int count = sscanf(line, "%127s %255s", name, value);
+        if(count <= 0) continue; // empty line
+        if(count == 1) {
+            println("missing value for", name, "in", path);
+            ok = false;
+        } else if(String(name) == String("config")) {
+            println("config files can't load other config files:", path);
+            ok = false;
+        } else {
+            ok = parse_mcts_config_arg(config, name, value);
+        }
+    }
+    fclose(file);
+    return ok;
+}
+
+bool check_mcts_config(const Mcts_Config &c) {
+    auto error = [](const char *msg) {
+        println("invalid config:", msg);
+        return false;
+    };
+    auto area = c.size.x * c.size.y;
+    if(c.size.x <= 0 || c.size.y <= 0 || area < 16 || area > 254) {
+        return error("the size has to be 16 <= width*height <= 254");
+    }
+    if(c.start_position.x >= 0 && (c.start_position.y < 0 || c.start_position.x >= c.size.x || c.start_position.y >= c.size.y)) {
+        return error("the start position has to be inside the level or {-1,*}");
+    }
+    if(c.timeout < 0 || (c.timeout == 0 && c.simulation_count <= 0)) {
+        return error("needs a timeout or a simulation count");
+    }
+    if(c.box_upper_cutoff == 0) {
+        return error("the upper box cutoff can't be 0");
+    }
+    if(c.depth_lower_cutoff < 0 || c.box_lower_cutoff < 0) {
+        return error("the lower cutoffs can't be negative");
+    }
+    if(c.memory_budget < 0 || (c.memory_budget > 0 && TREE_PARALLEL)) {
+        return error("the memory budget can't be negative or used with TREE_PARALLEL");
+    }
+    return true;
+}
+
+void print_mcts_config(const Mcts_Config &c) {
+    println("box cutoff:", "[", c.box_lower_cutoff, c.box_upper_cutoff,"]");
+    println("depth cutoff:", c.depth_lower_cutoff);
+    println("remove impossible:", c.remove_impossible);
+    println("arena allocator:", c.arena_allocator, c.scratch_rollout ? "(unused by the scratch rollout)" : "");
+    println("scratch rollout:", c.scratch_rollout);
+    println("enhanced move agent:", !c.simple_moves);
+    println("decision:", decision_kind_name(c.decision));
+    if(c.memory_budget > 0) {
+        println("memory budget:", c.memory_budget, "MB");
+    }
+    println("level size", c.size);
+}
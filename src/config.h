@@ -0,0 +1,54 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include "util.h"
+#include "settings.h"
+
+// The selection of the tree policy (see uct_enhancements.h)
+enum class Decision_Kind : u8 {
+    Ucb1,
+    Ucb1_Tuned,
+    Ucb_V,
+    Sp_Mcts,
+};
+
+/*
+    Parameters of a search that can be changed without rebuilding.
+    default_mcts_config takes them from settings.h, they can be overwritten by
+    command line arguments (--name value) or a file with one 'name value' per line
+    ('#' starts a comment). The names are the ones in parse_mcts_config_arg.
+
+    The booleans are read once per bloom/freeze/rollout, not in the inner loops.
+*/
+struct Mcts_Config {
+    Vector2i size;
+    Vector2i start_position; // {-1,*} for the middle
+    f64 timeout;             // 0: simulation_count rollouts instead
+    i64 simulation_count;
+    i32 depth_lower_cutoff;
+    i32 box_lower_cutoff;
+    i32 box_upper_cutoff;    // < 0: area/BOX_AREA_CUTOFF
+    bool remove_impossible;
+    bool simple_moves;
+    bool arena_allocator;    // only used without scratch_rollout
+    bool scratch_rollout;
+    bool add_good_levels;
+    f64 good_level_cut;
+    f64 memory_budget;       // MB of the tree, 0: no limit
+    Decision_Kind decision;
+};
+
+// Reads settings.h at the time of the call, the experiments change some of the values
+Mcts_Config default_mcts_config();
+// Returns false and prints the reason if name or value are invalid.
+// The name may start with '--', 'config' loads the file value.
+bool parse_mcts_config_arg(Mcts_Config *, const char *name, const char *value);
+// Pairs of --name value
+bool parse_mcts_config_args(Mcts_Config *, char **args, int count);
+bool load_mcts_config(Mcts_Config *, const char *path);
+// Returns false and prints the reason if the config can't be used
+bool check_mcts_config(const Mcts_Config &);
+void print_mcts_config(const Mcts_Config &);
+const char *decision_kind_name(Decision_Kind);
+
+#endif // CONFIG_H
@@ -5,6 +5,9 @@
 #include "mcts.h"
 #include "sokoban_example_levels.h"
 #include "allocator.h"
+#include "level_stream.h"
+#include <thread>
+#include <csignal>
 void print_and_check_settings();
 /*
 	All the experiments are in this File.
@@ -14,6 +17,19 @@ void print_and_check_settings();
 */
 
 
+// Set by SIGINT/SIGTERM after stop_runs_on_signal, the runs stop after their current rollout.
+// A second signal ends the process as usual.
+volatile sig_atomic_t g_stop_requested = 0;
+
+void stop_runs_on_signal() {
+	auto handler = [](int sig) {
+		g_stop_requested = 1;
+		signal(sig, SIG_DFL);
+	};
+	signal(SIGINT, handler);
+	signal(SIGTERM, handler);
+}
+
 template<bool extra_check = false>
 i64 run_mcts_timeout(Mcts *mcts, const Decision_Proc decision_proc, const f64 timeout) {
 	mcts->start();
@@ -30,13 +46,109 @@ i64 run_mcts_timeout(Mcts *mcts, const Decision_Proc decision_proc, const f64 ti
 				break;
 			}	
 		}
-		if(time_diff(point_start, point_end) >= timeout) {
+		if(time_diff(point_start, point_end) >= timeout || g_stop_requested) {
 			break;
 		}
 	}	
 	return counter;
 }
 
+isize get_thread_count() {
+	if(THREAD_COUNT > 0) {
+		return THREAD_COUNT;
+	}
+	// hardware_concurrency can return 0 if it isn't computable
+	return max<isize>(std::thread::hardware_concurrency(), 1);
+}
+
+/*
+	Runs proc(index) on thread_count threads and returns the sum of their results.
+	Every thread uses its own arena and random engine (see init_thread_allocators and g_random_engine).
+*/
+template<typename Proc>
+i64 run_on_threads(isize thread_count, Proc proc) {
+	release_assert(thread_count >= 1);
+	auto counters = make_array<i64>(thread_count);
+	auto worker = [&](isize index) {
+		init_thread_allocators();
+		counters[index] = proc(index);
+		destroy_thread_allocators();
+	};
+	auto threads = make_array<std::thread>(0, thread_count);
+	for_range(i, 0, thread_count) {
+		// placement new since Array doesn't construct its elements
+		new(&threads.data[i]) std::thread(worker, i);
+		threads.count += 1;
+	}
+	i64 counter = 0;
+	for_range(i, 0, thread_count) {
+		threads[i].join();
+		threads[i].~thread();
+		counter += counters[i];
+	}
+	threads.destroy();
+	counters.destroy();
+	return counter;
+}
+void print_parallel_info(i64 counter, f64 timeout, isize thread_count) {
+	println("threads:", thread_count);
+	println("rollouts/s per thread:", f64(counter)/(f64(thread_count)*timeout));
+	println("rollouts/s total:", f64(counter)/timeout);
+}
+
+/*
+	Root parallelization: runs thread_count independent trees, one per thread, for the same timeout.
+	mcts is the first tree, the other trees use the seeds mcts->seed + i.
+	At the end all finished levels are merged into mcts without duplicates.
+	If mcts streams its levels tree i uses queue i of the stream.
+	Returns the total amount of rollouts.
+*/
+i64 run_mcts_timeout_root_parallel(Mcts *mcts, const Decision_Proc decision_proc, const f64 timeout, isize thread_count) {
+	auto trees = make_array<Mcts *>(thread_count);
+	trees[0] = mcts;
+	for_range(i, 1, thread_count) {
+		trees[i] = new_mcts(mcts->seed + i, mcts->config);
+		trees[i]->quiet = true;
+		if(mcts->stream) {
+			release_assert(i < mcts->stream->queues.count, "the level stream needs a queue per thread");
+			trees[i]->stream = mcts->stream;
+			trees[i]->stream_queue = i;
+		}
+	}
+	i64 counter = run_on_threads(thread_count, [&](isize index) {
+		return run_mcts_timeout(trees[index], decision_proc, timeout);
+	});
+	for_range(i, 1, thread_count) {
+		merge_finished_levels(mcts, trees[i]);
+		delete_mcts(trees[i]);
+	}
+	print_parallel_info(counter, timeout, thread_count);
+	trees.destroy();
+	return counter;
+}
+
+/*
+	Tree parallelization: thread_count threads search the same tree for the given timeout.
+	Thread i uses the random seed mcts->seed + i. See mcts_parallel.cpp.
+	Returns the total amount of rollouts.
+*/
+i64 run_mcts_timeout_tree_parallel(Mcts *mcts, const Decision_Proc decision_proc, const f64 timeout, isize thread_count) {
+	mcts->node_allocator->thread_safe = true;
+	i64 counter = run_on_threads(thread_count, [&](isize index) {
+		mcts->start(index);
+		auto point_start = get_time();
+		i64 counter = 0;
+		while(time_diff(point_start, get_time()) < timeout && !g_stop_requested) {
+			uct_body_parallel(mcts, decision_proc);
+			counter += 1;
+		}
+		return counter;
+	});
+	print_parallel_info(counter, timeout, thread_count);
+	mcts->node_allocator->thread_safe = false;
+	return counter;
+}
+
 i64 run_mcts_timeout_and_bootstrap(Mcts **_mcts, const Decision_Proc decision_proc, const f64 timeout, bool delete_first = true, bool print_swap = true, bool add_old_levels = false) {
 	f64 delta = 1.0 - MCTS_BOOTSTRAP_DELTA;
 	const f64 bt_timeout = MCTS_BOOTSTRAP_DELTA * timeout;
@@ -56,8 +168,14 @@ i64 run_mcts_timeout_and_bootstrap(Mcts **_mcts, const Decision_Proc decision_pr
 		println(string);
 	}
 	string.destroy();
-	auto n_mcts = new_mcts_bootstrap(mcts->seed, mcts->size, mcts->start_position_tile);
+	auto config = mcts->config;
+	config.start_position = mcts->start_position_tile;
+	auto n_mcts = new_mcts_bootstrap(mcts->seed, config);
+	n_mcts->stream = mcts->stream;
+	n_mcts->stream_queue = mcts->stream_queue;
 	
+	// the best levels are at the end
+	mcts->sort_finished_levels();
 	auto n = min<isize>(MCTS_BOOTSTRAP_COUNT, mcts->finished_nodes.count);
 	for_range(i, 0, n) {
 		auto idx = mcts->finished_nodes.count - 1 - i;
@@ -69,9 +187,14 @@ i64 run_mcts_timeout_and_bootstrap(Mcts **_mcts, const Decision_Proc decision_pr
 	// println("1:", counter, old_mcts->root->rollout_count+mcts->root->rollout_count);
 	counter += run_mcts_timeout<true>(mcts, decision_proc, bt_timeout);
 	if(add_old_levels) {
+		// these have been published already
+		auto stream = mcts->stream;
+		mcts->stream = nullptr;
 		for_range(i, 0, old_mcts->finished_nodes.count) {			
-			mcts->finished_nodes.add(old_mcts->finished_nodes[i].clone());
+			auto &level = old_mcts->finished_nodes[i];
+			mcts->add_finished_level(level.grid, level.box_count, level.score, level.time_stamp);
 		}
+		mcts->stream = stream;
 	}
 	// println("2:", counter, old_mcts->root->rollout_count+mcts->root->rollout_count);
 	if(delete_first) {
@@ -88,6 +211,7 @@ f64 run_mcts_rollout_count(Mcts *mcts, const Decision_Proc decision_proc, const
 	auto point_start = get_time();
 	Chrono_Clock point_end;
 	for_range(i, 0, (isize)count){
+		if(g_stop_requested) break;
 		mcts->next_rollout(decision_proc);
 	}	
 	point_end = get_time();
@@ -106,13 +230,17 @@ isize get_malloc_allocation_size() {
 	auto info = mallinfo2();
 	const isize TO_KB = 1000;
 	const isize TO_MB = 1000*TO_KB;
-	return info.uordblks/TO_KB;	
+	// hblkhd: big blocks like the chunks of the node pool are mmapped
+	return (info.uordblks + info.hblkhd)/TO_KB;	
 	#endif // GCC
 	return 0;
 }
 Mcts *new_experiment_mcts(u64 seed) {
     return new_mcts(seed, DEFAULT_BOARD_SIZE, DEFAULT_START_POSITION);
 }
+Mcts *new_experiment_mcts(u64 seed, const Mcts_Config &config) {
+    return new_mcts(seed, config);
+}
 struct Experiment_Info {    
     f64 best_score;
 	f64 best_score_time;
@@ -144,13 +272,13 @@ Experiment_Info_Pair run_experiment_mcts_timeout_bootstrap(u64 seed, Decision_Pr
 	auto mcts_b = mcts;
     run_mcts_timeout_and_bootstrap(&mcts_b, decision, timeout, false, false);
 	if(data) {
-		for_range(i, 0, mcts->finished_nodes.count) {
-			f64 time = time_diff(mcts->time_start, mcts->finished_nodes[i].time_stamp);
-			data->add(Score_Tracking_Data{time, mcts->finished_nodes[i].score});
+		for_range(i, 0, mcts->score_history.count) {
+			f64 time = time_diff(mcts->time_start, mcts->score_history[i].time_stamp);
+			data->add(Score_Tracking_Data{time, mcts->score_history[i].score});
 		}
-		for_range(i, 0, mcts_b->finished_nodes.count) {
-			f64 time = time_diff(mcts_b->time_start, mcts_b->finished_nodes[i].time_stamp);
-			data->add(Score_Tracking_Data{time, mcts_b->finished_nodes[i].score});
+		for_range(i, 0, mcts_b->score_history.count) {
+			f64 time = time_diff(mcts_b->time_start, mcts_b->score_history[i].time_stamp);
+			data->add(Score_Tracking_Data{time, mcts_b->score_history[i].score});
 		}
 	}	
 	Experiment_Info_Pair infos;
@@ -160,14 +288,29 @@ Experiment_Info_Pair run_experiment_mcts_timeout_bootstrap(u64 seed, Decision_Pr
     delete_mcts(mcts);
 	return infos;
 }
+// With the config of the experiment instead of default_mcts_config
+Experiment_Info run_experiment_mcts_timeout(u64 seed, Decision_Proc decision, f64 timeout, const Mcts_Config &config, Array<Score_Tracking_Data> *data = nullptr) {
+    auto mcts = new_experiment_mcts(seed, config);
+	auto start = get_time();
+    run_mcts_timeout(mcts, decision, timeout);
+	if(data) {
+		for_range(i, 0, mcts->score_history.count) {
+			f64 time = time_diff(start, mcts->score_history[i].time_stamp);
+			data->add(Score_Tracking_Data{time, mcts->score_history[i].score});
+		}
+	}	
+	auto info = get_experiment_info(mcts, start);
+    delete_mcts(mcts);
+	return info;
+}
 Experiment_Info run_experiment_mcts_timeout(u64 seed, Decision_Proc decision, f64 timeout, Array<Score_Tracking_Data> *data = nullptr) {
     auto mcts = new_experiment_mcts(seed);
 	auto start = get_time();
     run_mcts_timeout(mcts, decision, timeout);
 	if(data) {
-		for_range(i, 0, mcts->finished_nodes.count) {
-			f64 time = time_diff(start, mcts->finished_nodes[i].time_stamp);
-			data->add(Score_Tracking_Data{time, mcts->finished_nodes[i].score});
+		for_range(i, 0, mcts->score_history.count) {
+			f64 time = time_diff(start, mcts->score_history[i].time_stamp);
+			data->add(Score_Tracking_Data{time, mcts->score_history[i].score});
 		}
 	}	
 	auto info = get_experiment_info(mcts, start);
@@ -179,9 +322,9 @@ Experiment_Info run_experiment_mcts_count(u64 seed, Decision_Proc decision, i64
 	auto start = get_time();
     run_mcts_rollout_count(mcts, decision, count);
 	if(data) {
-		for_range(i, 0, mcts->finished_nodes.count) {
-			f64 time = time_diff(start, mcts->finished_nodes[i].time_stamp);
-			data->add(Score_Tracking_Data{time, mcts->finished_nodes[i].score});
+		for_range(i, 0, mcts->score_history.count) {
+			f64 time = time_diff(start, mcts->score_history[i].time_stamp);
+			data->add(Score_Tracking_Data{time, mcts->score_history[i].score});
 		}
 	}
 	auto info = get_experiment_info(mcts, start);
@@ -257,9 +400,7 @@ Array<Data_Average> get_averages(Array<Array<Experiment_Info>> &data) {
 }
 
 void free_globals() {
-	#if ARENA_ALLOCATOR
-	global_arena_allocator->destroy();
-	#endif // ARENA_ALLOCATOR
+	destroy_thread_allocators();
 }
 
 void init_experiment(unsigned int r_seed = 0) {
@@ -519,6 +660,9 @@ void experiment_arena_allocator() {
 	DEPTH_LOWER_CUTOFF = 10;
 	release_assert(REMOVE_IMPOSSIBLE && BOX_LOWER_CUTOFF == 1 && USE_SIMPLE_MOVES == false && UCB1_C == 1.0/SQRT2);
 	release_assert(DEPTH_LOWER_CUTOFF == 10 &&  BOX_UPPER_CUTOFF == 9);
+	// the scratch rollout doesn't use the arena, these runs simulate on cloned nodes
+	Mcts_Config config = default_mcts_config();
+	config.scratch_rollout = false;
 	const i32 ITER_COUNT = 10;
 	const f64 TIMEOUT = 30.0;	
 	const i32 PARAM_COUNT = 1;
@@ -535,11 +679,12 @@ void experiment_arena_allocator() {
 	release_assert(ITER_COUNT == carray_len(seeds));
 	println("remove_impossible:", REMOVE_IMPOSSIBLE);
 	println("use arena_allocator:", ARENA_ALLOCATOR);
+	println("scratch rollout:", config.scratch_rollout);
 
 	for_range(iteration, 0, (i32)ITER_COUNT) {
 		u64 seed = seeds[iteration];
 		println("iteration", iteration);
-		data[0].add(run_experiment_mcts_timeout(seed, node_ucb1, TIMEOUT));
+		data[0].add(run_experiment_mcts_timeout(seed, node_ucb1, TIMEOUT, config));
 	}
 	auto avrg = get_averages(data);
 	print_averages(avrg);
@@ -596,6 +741,8 @@ void experiment_mcts_bootstrap() {
 // Mersenne even though it is slower (0.5 * Rand) seems to lead to *way* better results
 // but since a proper comparison isn't possible for such a small amount of iterations it has not been further discussed
 // in the paper.
+// xoshiro (RANDOM_XOSHIRO, the default) is faster than both and doesn't suffer from rand's poor low bits.
+// Set RANDOM_ENGINE in settings.h to compare them.
 void experiment_rng() {
 	release_assert(!MCTS_BOOTSTRAP && REMOVE_IMPOSSIBLE && ARENA_ALLOCATOR && DEPTH_LOWER_CUTOFF == 7 &&  BOX_UPPER_CUTOFF == 9 && BOX_LOWER_CUTOFF == 1 && USE_SIMPLE_MOVES == false);
 	const i32 ITER_COUNT = 10;
@@ -611,7 +758,7 @@ void experiment_rng() {
 	
 	u64 seeds[ITER_COUNT] = {927255397 , 1105921952 , 1026354299 , 1758167147 , 1603941903 , 1676667435 , 532609334 , 182937063 , 1789453788 , 644406624};
 	release_assert(ITER_COUNT == carray_len(seeds));
-	println("use mersenne:", MT_RANDOM);
+	println("use mersenne:", MT_RANDOM, "engine:", RANDOM_ENGINE);
 
 	for_range(iteration, 0, (i32)ITER_COUNT) {
 		u64 seed = seeds[iteration];
@@ -0,0 +1,280 @@
+#ifndef GENERATE_H
+#define GENERATE_H
+
+#include "mcts.h"
+#include "experiment.h"
+#include "level_stream.h"
+#include <filesystem>
+#include <inttypes.h>
+
+/*
+	Headless batch mode:
+		prog generate --count N --size WxH --timeout T --jobs J --out dir [--seed S] [--per-run K] [--format text|corpus]
+			[--checkpoint dir] [--resume dir]
+
+	Runs ceil(N/K) searches with the seeds S, S+1, ... on J threads, each one
+	new_mcts + run_mcts_timeout. Every search contributes its K best levels
+	(less if it didn't find as many), they are written to dir/generated_<S>.txt
+	through a Level_Stream as soon as a search is done.
+	With --format corpus they are appended to the level corpus dir/generated_<S>.corpus
+	together with their score and seed instead (see level_corpus.h).
+	The other arguments go to the Mcts_Config of the searches (see config.h),
+	e.g. --decision ucb-v or --config file.
+
+	With --checkpoint dir every search is saved to dir/checkpoint_<seed>.bin at its end, SIGINT or SIGTERM
+	stop the running searches (they are saved and publish their levels) and the ones which haven't started.
+	With --resume dir a search continues the one in dir/checkpoint_<seed>.bin for another timeout
+	(or simulation count) if there is one, the same batch with the same --seed continues all of them.
+	The saved settings of a search stay, see mcts_checkpoint.cpp.
+*/
+struct Generate_Args {
+	i64 count = 100;
+	Mcts_Config config = default_mcts_config();
+	isize jobs = 0; // 0: get_thread_count()
+	const char *out = "saved_levels";
+	u64 seed = 0;   // 0: random
+	i64 per_run = 1;
+	Level_Format format = Level_Format::Text;
+	const char *checkpoint = nullptr; // directories
+	const char *resume = nullptr;
+};
+
+void print_generate_usage() {
+	println("usage: prog generate --count N --size WxH --timeout T --jobs J --out dir [--seed S] [--per-run K] [--format text|corpus] [--checkpoint dir] [--resume dir] [--<config setting> value]");
+}
+
+// Returns false if the arguments are invalid
+bool parse_generate_args(Generate_Args *result, char **args, int count) {
+	Generate_Args a = {};
+	// args[0] is the program, args[1] "generate"
+	for(int i = 2; i < count; i += 2) {
+		if(i+1 >= count) {
+			println("missing value for", args[i]);
+			return false;
+		}
+		String name = args[i];
+		const char *value = args[i+1];
+		bool ok;
+		if(name == String("--count")) {
+			ok = sscanf(value, "%" SCNd64, &a.count) == 1 && a.count > 0;
+		} else if(name == String("--jobs")) {
+			long long jobs;
+			ok = sscanf(value, "%lld", &jobs) == 1 && jobs >= 0;
+			a.jobs = isize(jobs);
+		} else if(name == String("--out")) {
+			a.out = value;
+			ok = true;
+		} else if(name == String("--seed")) {
+			ok = sscanf(value, "%" SCNu64, &a.seed) == 1;
+		} else if(name == String("--per-run")) {
+			ok = sscanf(value, "%" SCNd64, &a.per_run) == 1 && 0 < a.per_run && a.per_run <= LEVEL_SET_SIZE;
+		} else if(name == String("--checkpoint")) {
+			a.checkpoint = value;
+			ok = true;
+		} else if(name == String("--resume")) {
+			a.resume = value;
+			ok = true;
+		} else if(name == String("--format")) {
+			ok = true;
+			if(String(value) == String("text")) {
+				a.format = Level_Format::Text;
+			} else if(String(value) == String("corpus")) {
+				a.format = Level_Format::Corpus;
+			} else {
+				ok = false;
+			}
+		} else if(!parse_mcts_config_arg(&a.config, args[i], value)) {
+			return false;
+		} else {
+			ok = true;
+		}
+		if(!ok) {
+			println("bad value for", args[i], ":", value);
+			return false;
+		}
+	}
+	if(!check_mcts_config(a.config)) {
+		return false;
+	}
+	if(a.jobs == 0) {
+		a.jobs = get_thread_count();
+	}
+	if(a.seed == 0) {
+		a.seed = std::random_device{}();
+	}
+	*result = a;
+	return true;
+}
+
+// dir/checkpoint_<seed>.bin, false if it doesn't fit into path
+bool get_checkpoint_path(char *path, isize size, const char *dir, u64 seed) {
+	return snprintf(path, size, "%s/checkpoint_%llu.bin", dir, (unsigned long long)seed) < size;
+}
+
+// Entry point of 'prog generate ...', returns the exit code
+int run_generate(char **args, int count) {
+	Generate_Args a;
+	if(!parse_generate_args(&a, args, count)) {
+		print_generate_usage();
+		return 1;
+	}
+	std::error_code error;
+	std::filesystem::create_directories(a.out, error);
+	if(error) {
+		println("couldn't create", a.out);
+		return 1;
+	}
+	if(a.checkpoint) {
+		std::filesystem::create_directories(a.checkpoint, error);
+		if(error) {
+			println("couldn't create", a.checkpoint);
+			return 1;
+		}
+		stop_runs_on_signal();
+	}
+	char path[1024];
+	const char *extension = (a.format == Level_Format::Corpus) ? CORPUS_EXTENSION : ".txt";
+	snprintf(path, sizeof(path), "%s/generated_%llu%s", a.out, (unsigned long long)a.seed, extension);
+
+	const i64 run_count = (a.count + a.per_run - 1) / a.per_run;
+	const isize jobs = min<isize>(a.jobs, run_count);
+	const auto &config = a.config;
+	print_mcts_config(config);
+	if(config.timeout > 0) {
+		println("generating", a.count, "levels with", run_count, "searches of", config.timeout, "s on", jobs, "threads");
+	} else {
+		println("generating", a.count, "levels with", run_count, "searches of", config.simulation_count, "rollouts on", jobs, "threads");
+	}
+	const Decision_Proc decision_proc = get_decision_proc(config.decision);
+
+	// a batch waits for the writer instead of losing levels
+	Level_Stream stream;
+	stream.blocking = true;
+	if(!start_level_stream(&stream, path, jobs, a.format)) {
+		return 1;
+	}
+	i64 next_run = 0;
+	i64 empty_runs = 0;
+	i64 published = 0;
+	i64 started = 0;
+	i64 resumed = 0;
+	i64 unsaved = 0;
+	auto cpu_start = get_process_cpu_time();
+	auto point_start = get_time();
+
+	// Every thread takes the next search until all are done, its levels go to queue index of the stream
+	i64 rollouts = run_on_threads(jobs, [&](isize index) {
+		i64 counter = 0;
+		char checkpoint_path[1024];
+		for(i64 run = atomic_fetch_add(&next_run, 1); run < run_count && !g_stop_requested; run = atomic_fetch_add(&next_run, 1)) {
+			// a seed of 0 would be a random one
+			u64 seed = a.seed + u64(run);
+			if(seed == 0) seed = 1;
+			atomic_fetch_add(&started, 1);
+			Mcts *mcts = nullptr;
+			if(a.resume && get_checkpoint_path(checkpoint_path, sizeof(checkpoint_path), a.resume, seed)
+				&& std::filesystem::exists(checkpoint_path)) {
+				// the search starts anew if the checkpoint can't be loaded, the loader prints why
+				mcts = load_mcts_checkpoint(checkpoint_path);
+				if(mcts) {
+					atomic_fetch_add(&resumed, 1);
+				}
+			}
+			if(!mcts) {
+				mcts = new_mcts(seed, config);
+			}
+			mcts->quiet = true;
+			if(config.timeout > 0) {
+				counter += run_mcts_timeout(mcts, decision_proc, config.timeout);
+			} else {
+				run_mcts_rollout_count(mcts, decision_proc, config.simulation_count);
+				counter += config.simulation_count;
+			}
+			// from this thread, the search ran with its random engines
+			if(a.checkpoint) {
+				bool saved = get_checkpoint_path(checkpoint_path, sizeof(checkpoint_path), a.checkpoint, seed)
+					&& save_mcts_checkpoint(mcts, checkpoint_path);
+				if(!saved) {
+					atomic_fetch_add(&unsaved, 1);
+				}
+			}
+
+			// the last search only fills up the count
+			i64 n = min(a.per_run, a.count - run*a.per_run);
+			n = min<i64>(n, mcts->finished_nodes.count);
+			if(n == 0) {
+				atomic_fetch_add(&empty_runs, 1);
+			}
+			// the best levels are at the end
+			mcts->sort_finished_levels();
+			for_range(i, 0, n) {
+				auto &level = mcts->finished_nodes[mcts->finished_nodes.count - 1 - i];
+				stream.publish(index, level.grid, level.box_count, level.score, seed);
+			}
+			atomic_fetch_add(&published, n);
+			delete_mcts(mcts);
+		}
+		return counter;
+	});
+
+	bool stream_ok = stop_level_stream(&stream);
+	auto duration = time_diff(point_start, get_time());
+	auto cpu_time = get_process_cpu_time() - cpu_start;
+	auto cores = max<isize>(std::thread::hardware_concurrency(), 1);
+
+	println("levels written:", stream.written, "to", path);
+	if(resumed > 0) {
+		println("resumed searches:", resumed, "from", a.resume);
+	}
+	if(g_stop_requested) {
+		println("stopped after", started, "of", run_count, "searches");
+	}
+	if(empty_runs > 0) {
+		println("searches without a level:", empty_runs);
+	}
+	if(stream.written < published) {
+		println("error: only", stream.written, "of", published, "levels could be written");
+		return 1;
+	}
+	if(!stream_ok) {
+		println("error: couldn't write", path, "completely");
+		return 1;
+	}
+	if(unsaved > 0) {
+		println("error:", unsaved, "searches couldn't be saved to", a.checkpoint);
+		return 1;
+	}
+	if(stream.written < a.count) {
+		println("warning: the searches found", stream.written, "of", a.count, "levels, more rollouts or --per-run 1 find more");
+	}
+	println("duration:", duration, "s | levels/s:", f64(stream.written)/duration, "| rollouts/s:", f64(rollouts)/duration);
+	println("cpu time:", cpu_time, "s | cpu utilization:", 100.0*cpu_time/(duration*f64(cores)), "% of", cores, "cores");
+	if(config.arena_allocator && !config.scratch_rollout) {
+		print_arena_stats(get_arena_stats());
+	}
+	return 0;
+}
+
+/*
+	Conversion between the text format of save_level_set and level corpora:
+		prog convert levels.txt levels.corpus
+		prog convert levels.corpus levels.txt
+	The direction is given by the extension of the output (CORPUS_EXTENSION), a corpus is appended to.
+*/
+int run_convert(char **args, int count) {
+	if(count != 4) {
+		println("usage: prog convert <in> <out>, one of them a", CORPUS_EXTENSION, "file");
+		return 1;
+	}
+	const char *in = args[2];
+	const char *out = args[3];
+	auto point_start = get_time();
+	i64 levels = is_corpus_path(out) ? convert_text_to_corpus(in, out) : convert_corpus_to_text(in, out);
+	if(levels < 0) {
+		return 1;
+	}
+	println("converted", levels, "levels from", in, "to", out, "in", time_diff(point_start, get_time()), "s");
+	return 0;
+}
+
+#endif // GENERATE_H
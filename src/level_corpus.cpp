@@ -0,0 +1,306 @@
+#include "level_corpus.h"
+#include "allocator.h"
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define CORPUS_MAGIC 0x5355504f43534f4bull // "KOSCOPUS"
+#define CORPUS_VERSION 1
+
+// The 3 bit codes of the cells, the index is the code
+const Pawn CORPUS_PAWNS[] = {
+    Pawn::Empty, Pawn::Block, Pawn::Box, Pawn::Goal, Pawn::Box_On_Goal, Pawn::Pusher, Pawn::Pusher_On_Goal,
+};
+inline u8 pawn_to_corpus_code(Pawn pawn) {
+    switch(pawn) {
+        case Pawn::Empty: return 0;
+        case Pawn::Block: return 1;
+        case Pawn::Box: return 2;
+        case Pawn::Goal: return 3;
+        case Pawn::Box_On_Goal: return 4;
+        case Pawn::Pusher: return 5;
+        case Pawn::Pusher_On_Goal: return 6;
+        default:
+        crash("unknown pawn in a corpus level");
+    }
+    return 0;
+}
+
+// Seek with 64 bit offsets
+static bool seek_file(FILE *file, i64 offset) {
+    #ifdef _WIN32
+    return _fseeki64(file, offset, SEEK_SET) == 0;
+    #else
+    return fseeko(file, offset, SEEK_SET) == 0;
+    #endif // _WIN32
+}
+
+static Corpus_Header make_corpus_header(i64 count) {
+    Corpus_Header header = {};
+    header.magic = CORPUS_MAGIC;
+    header.version = CORPUS_VERSION;
+    header.record_size = CORPUS_RECORD_SIZE;
+    header.count = count;
+    return header;
+}
+static bool is_corpus_header(const Corpus_Header &header) {
+    return header.magic == CORPUS_MAGIC && header.version == CORPUS_VERSION
+        && header.record_size == CORPUS_RECORD_SIZE && header.count >= 0;
+}
+
+// Cell i takes the bits 3i, 3i+1, 3i+2 of cells (from the lowest bit of the first byte on)
+Corpus_Record make_corpus_record(Grid &grid, i32 box_count, f64 score, u64 seed) {
+    release_assert(0 < grid.width && grid.width <= 255 && 0 < grid.height && grid.height <= 255
+        && grid.get_count() <= MAX_CELL_COUNT, "level too big for a corpus");
+    Corpus_Record record = {};
+    record.seed = seed;
+    record.score = f32(score);
+    record.box_count = i16(box_count);
+    record.width = u8(grid.width);
+    record.height = u8(grid.height);
+    for_range(i, 0, grid.get_count()) {
+        u32 code = pawn_to_corpus_code(grid.get(i));
+        isize bit = 3*i;
+        record.cells[bit >> 3] |= u8(code << (bit & 7));
+        if((bit & 7) > 5) {
+            record.cells[(bit >> 3) + 1] |= u8(code >> (8 - (bit & 7)));
+        }
+    }
+    return record;
+}
+
+Grid corpus_record_grid(const Corpus_Record &record) {
+    Grid grid = make_grid(record.width, record.height);
+    for_range(i, 0, grid.get_count()) {
+        isize bit = 3*i;
+        u32 code = record.cells[bit >> 3] >> (bit & 7);
+        if((bit & 7) > 5) {
+            code |= u32(record.cells[(bit >> 3) + 1]) << (8 - (bit & 7));
+        }
+        code &= 7;
+        release_assert(code < carray_len(CORPUS_PAWNS), "bad cell in a corpus level");
+        grid.set(i, CORPUS_PAWNS[code]);
+    }
+    return grid;
+}
+
+bool open_corpus_writer(Corpus_Writer *writer, const char *path) {
+    *writer = {};
+    FILE *file = fopen(path, "r+b");
+    Corpus_Header header = make_corpus_header(0);
+    if(file) {
+        if(fread(&header, sizeof(header), 1, file) != 1 || !is_corpus_header(header)) {
+            println(path, "isn't a level corpus");
+            fclose(file);
+            return false;
+        }
+    } else {
+        file = fopen(path, "w+b");
+        if(!file) {
+            println("couldn't open", path);
+            return false;
+        }
+        if(fwrite(&header, sizeof(header), 1, file) != 1) {
+            println("couldn't write", path);
+            fclose(file);
+            return false;
+        }
+    }
+    // the records behind the count are overwritten
+    if(!seek_file(file, sizeof(Corpus_Header) + header.count*CORPUS_RECORD_SIZE)) {
+        println("couldn't open", path);
+        fclose(file);
+        return false;
+    }
+    writer->file = file;
+    writer->count = header.count;
+    writer->flushed = header.count;
+    return true;
+}
+
+bool Corpus_Writer::append(Grid &grid, i32 box_count, f64 score, u64 seed) {
+    if(failed) {
+        return false;
+    }
+    Corpus_Record record = make_corpus_record(grid, box_count, score, seed);
+    if(fwrite(&record, sizeof(record), 1, file) != 1) {
+        failed = true;
+        return false;
+    }
+    count += 1;
+    return true;
+}
+
+bool Corpus_Writer::flush() {
+    if(failed) {
+        return false;
+    }
+    if(flushed == count) {
+        return true;
+    }
+    // the records have to be in the file before the count which makes them visible
+    Corpus_Header header = make_corpus_header(count);
+    failed = fflush(file) != 0 || !seek_file(file, 0) || fwrite(&header, sizeof(header), 1, file) != 1
+        || !seek_file(file, sizeof(Corpus_Header) + count*CORPUS_RECORD_SIZE) || fflush(file) != 0;
+    if(!failed) {
+        flushed = count;
+    }
+    return !failed;
+}
+
+bool close_corpus_writer(Corpus_Writer *writer) {
+    bool ok = writer->flush() && !ferror(writer->file);
+    ok = (fclose(writer->file) == 0) && ok;
+    if(!ok) {
+        println("couldn't write the level corpus");
+    }
+    *writer = {};
+    return ok;
+}
+
+Level Level_Corpus::get(i64 id) {
+    auto &r = record(id);
+    Level level = {};
+    level.grid = corpus_record_grid(r);
+    level.box_count = r.box_count;
+    level.score = r.score;
+    return level;
+}
+
+bool open_level_corpus(Level_Corpus *corpus, const char *path) {
+    *corpus = {};
+    FILE *file = fopen(path, "rb");
+    if(!file) {
+        println("couldn't open", path);
+        return false;
+    }
+    Corpus_Header header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 && is_corpus_header(header);
+    isize size = 0;
+    void *data = nullptr;
+    #ifdef _WIN32
+    if(ok) {
+        ok = _fseeki64(file, 0, SEEK_END) == 0;
+        size = isize(_ftelli64(file));
+    }
+    if(ok) {
+        data = global_default_allocator->_alloc(size);
+        ok = data && seek_file(file, 0) && fread(data, 1, size, file) == usize(size);
+    }
+    #else
+    struct stat info;
+    if(ok) {
+        ok = fstat(fileno(file), &info) == 0;
+        size = isize(info.st_size);
+    }
+    if(ok) {
+        data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fileno(file), 0);
+        if(data == MAP_FAILED) {
+            data = nullptr;
+            ok = false;
+        }
+    }
+    #endif // _WIN32
+    fclose(file);
+    corpus->data = (const u8 *)data;
+    corpus->size = size;
+    if(!ok) {
+        println("couldn't read the level corpus", path);
+        close_level_corpus(corpus);
+        return false;
+    }
+    // a writer might not have flushed the count yet or have been stopped in the middle of a record
+    corpus->count = min<i64>(header.count, (size - isize(sizeof(Corpus_Header))) / CORPUS_RECORD_SIZE);
+    return true;
+}
+
+void close_level_corpus(Level_Corpus *corpus) {
+    if(corpus->data) {
+        #ifdef _WIN32
+        global_default_allocator->_free((void *)corpus->data);
+        #else
+        munmap((void *)corpus->data, corpus->size);
+        #endif // _WIN32
+    }
+    *corpus = {};
+}
+
+bool is_corpus_path(const char *path) {
+    String name = path;
+    String extension = CORPUS_EXTENSION;
+    return name.count >= extension.count && String(path + name.count - extension.count) == extension;
+}
+
+i64 convert_text_to_corpus(const char *text_path, const char *corpus_path) {
+    FILE *text = fopen(text_path, "r");
+    if(!text) {
+        println("couldn't open", text_path);
+        return -1;
+    }
+    Corpus_Writer writer;
+    if(!open_corpus_writer(&writer, corpus_path)) {
+        fclose(text);
+        return -1;
+    }
+    i64 count = 0;
+    i32 width, height;
+    bool ok = true;
+    bool written = true;
+    while(ok && written && fscanf(text, " LEVEL %d %d", &width, &height) == 2) {
+        if(width <= 0 || height <= 0 || width*height > MAX_CELL_COUNT) {
+            ok = false;
+            break;
+        }
+        Grid grid = make_grid(width, height);
+        i32 box_count = 0;
+        // the cells row by row, anything else (the line breaks) is skipped
+        for(isize i = 0; i < grid.get_count();) {
+            int c = fgetc(text);
+            Pawn pawn;
+            if(c == EOF) {
+                ok = false;
+                break;
+            }
+            if(!char_to_pawn(char(c), &pawn)) continue;
+            grid.set(i, pawn);
+            box_count += pawn_is_box(pawn);
+            i += 1;
+        }
+        if(ok) {
+            written = writer.append(grid, box_count, 0, 0);
+            count += written;
+        }
+        grid.destroy();
+    }
+    if(written && (!ok || !feof(text))) {
+        println("bad level", count, "in", text_path);
+        ok = false;
+    }
+    fclose(text);
+    written = close_corpus_writer(&writer) && written;
+    return ok && written ? count : -1;
+}
+
+i64 convert_corpus_to_text(const char *corpus_path, const char *text_path) {
+    Level_Corpus corpus;
+    if(!open_level_corpus(&corpus, corpus_path)) {
+        return -1;
+    }
+    FILE *text = fopen(text_path, "w");
+    if(!text) {
+        println("couldn't open", text_path);
+        close_level_corpus(&corpus);
+        return -1;
+    }
+    for_range(i, 0, corpus.count) {
+        Grid grid = corpus_record_grid(corpus.record(i));
+        write_level(text, grid);
+        grid.destroy();
+    }
+    bool ok = !ferror(text);
+    ok = (fclose(text) == 0) && ok;
+    i64 count = corpus.count;
+    close_level_corpus(&corpus);
+    return ok ? count : -1;
+}
@@ -0,0 +1,88 @@
+#ifndef LEVEL_CORPUS_H
+#define LEVEL_CORPUS_H
+
+#include "util.h"
+#include "sokoban.h"
+#include <stdio.h>
+
+/*
+    Binary container for big sets of levels (the text format of save_level_set needs a parse of the
+    whole file to find a level).
+
+    File: Corpus_Header followed by count records of CORPUS_RECORD_SIZE bytes,
+    the record of level id starts at sizeof(Corpus_Header) + id*CORPUS_RECORD_SIZE.
+    A record has the size of the grid, the score, the box count, the seed of the search that found it
+    and the cells with 3 bits each (see pawn_to_corpus_code), every grid up to MAX_CELL_COUNT fits.
+
+    A Corpus_Writer appends to a new or an existing corpus, flush writes the count into the header.
+    Records behind the count (the writer has been stopped before the flush) are overwritten by the next writer
+    and ignored by readers, so a corpus can be read while it is being generated.
+    After a failed write the writer doesn't write anything anymore, the header keeps the count of the last
+    flush and the corpus stays valid up to it.
+    A Level_Corpus maps the file and decodes a level when it's asked for.
+    The files use the byte order of the machine.
+*/
+#define CORPUS_EXTENSION ".corpus"
+#define CORPUS_CELL_BYTES ((3*MAX_CELL_COUNT + 7) / 8)
+
+struct Corpus_Header {
+    u64 magic;
+    u32 version;
+    u32 record_size;
+    i64 count;
+};
+
+struct Corpus_Record {
+    u64 seed;
+    f32 score;
+    i16 box_count;
+    u8 width;
+    u8 height;
+    u8 cells[CORPUS_CELL_BYTES];
+};
+#define CORPUS_RECORD_SIZE isize(sizeof(Corpus_Record))
+
+Corpus_Record make_corpus_record(Grid &, i32 box_count, f64 score, u64 seed);
+Grid corpus_record_grid(const Corpus_Record &);
+
+struct Corpus_Writer {
+    FILE *file = nullptr;
+    i64 count = 0;   // levels in the file
+    i64 flushed = 0; // count in the header
+    bool failed = false; // a write failed
+
+    // Returns false if the record couldn't be written
+    bool append(Grid &, i32 box_count, f64 score, u64 seed);
+    // Writes the count into the header, readers see the levels up to it. Returns false if it couldn't.
+    bool flush();
+};
+// Creates path or continues the corpus in it. Returns false if the file can't be opened or isn't a corpus.
+bool open_corpus_writer(Corpus_Writer *, const char *path);
+// Flushes and closes the file, returns false if a write failed
+bool close_corpus_writer(Corpus_Writer *);
+
+struct Level_Corpus {
+    const u8 *data = nullptr; // the whole file
+    isize size = 0;
+    i64 count = 0;
+
+    const Corpus_Record &record(i64 id) {
+        assert(0 <= id && id < count);
+        return *(const Corpus_Record *)(data + sizeof(Corpus_Header) + id*CORPUS_RECORD_SIZE);
+    }
+    // The level with a new grid
+    Level get(i64 id);
+};
+// Maps the corpus in path, returns false if it can't be read
+bool open_level_corpus(Level_Corpus *, const char *path);
+void close_level_corpus(Level_Corpus *);
+
+// Whether the path ends with CORPUS_EXTENSION
+bool is_corpus_path(const char *);
+// Converters between the text format (LEVEL w h, see write_level) and corpora, an existing corpus is appended to.
+// The text has no scores and seeds, they are 0 in the corpus and get lost the other way.
+// Return the level count or -1 if a file can't be read/written completely.
+i64 convert_text_to_corpus(const char *text_path, const char *corpus_path);
+i64 convert_corpus_to_text(const char *corpus_path, const char *text_path);
+
+#endif // LEVEL_CORPUS_H
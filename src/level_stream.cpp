@@ -0,0 +1,209 @@
+#include "level_stream.h"
+#include "allocator.h"
+
+Level_Queue make_level_queue(isize capacity) {
+    assert(capacity > 0 && (capacity & (capacity - 1)) == 0);
+    Level_Queue queue = {};
+    queue.capacity = capacity;
+    queue.slots = mem_alloc<Stream_Level>(capacity);
+    release_assert(queue.slots, "level queue out of memory");
+    return queue;
+}
+
+bool Level_Queue::push(const Stream_Level &level) {
+    if(full()) {
+        return false;
+    }
+    i64 position = tail;
+    slots[position & (capacity - 1)] = level;
+    atomic_store_release(&tail, position + 1);
+    return true;
+}
+
+bool Level_Queue::pop(Stream_Level *level) {
+    i64 position = head;
+    if(position == atomic_load_acquire(&tail)) {
+        return false;
+    }
+    *level = slots[position & (capacity - 1)];
+    atomic_store_release(&head, position + 1);
+    return true;
+}
+
+void Level_Queue::destroy() {
+    Stream_Level it;
+    while(pop(&it)) {
+        it.level.grid.destroy();
+    }
+    mem_free(slots);
+    *this = {};
+}
+
+bool Level_Stream::publish(isize queue, Grid &grid, i32 box_count, f64 score, u64 seed) {
+    auto &q = queues[queue];
+    if(!blocking && q.full()) {
+        q.dropped += 1;
+        return false;
+    }
+    // The writer thread frees the grid, so it can't come from an arena
+    Allocator *previous_allocator = set_allocator(global_default_allocator);
+    Stream_Level it = {make_level(grid, box_count, score, get_time()), seed};
+    set_allocator(previous_allocator);
+    while(!q.push(it)) {
+        std::unique_lock<std::mutex> lock(mutex);
+        space.wait(lock, [&]() { return !q.full(); });
+    }
+    // under the mutex the writer is either before its check of the queues or waiting
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+    }
+    wake.notify_one();
+    return true;
+}
+
+// Returns true if a level has been taken from a queue
+static bool consume_queued_levels(Level_Stream *stream) {
+    bool any = false;
+    for_range(i, 0, stream->queues.count) {
+        Stream_Level it;
+        while(stream->queues[i].pop(&it)) {
+            if(stream->written + stream->failed == 0) {
+                stream->time_first_level = get_time();
+            }
+            bool ok = true;
+            for_range(c, 0, stream->consumers.count) {
+                auto &consumer = stream->consumers[c];
+                ok = consumer.consume(consumer.data, it) && ok;
+            }
+            it.level.grid.destroy();
+            if(ok) {
+                stream->written += 1;
+            } else {
+                stream->failed += 1;
+            }
+            any = true;
+        }
+    }
+    return any;
+}
+
+static bool has_queued_levels(Level_Stream *stream) {
+    for_range(i, 0, stream->queues.count) {
+        if(!stream->queues[i].empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool write_text_level(void *data, Stream_Level &it) {
+    FILE *file = (FILE *)data;
+    write_level(file, it.level.grid);
+    return !ferror(file);
+}
+// readers of the file see a level right away
+static void flush_text_file(void *data) {
+    fflush((FILE *)data);
+}
+static bool write_corpus_level(void *data, Stream_Level &it) {
+    auto &level = it.level;
+    return ((Corpus_Writer *)data)->append(level.grid, level.box_count, level.score, it.seed);
+}
+static void flush_corpus(void *data) {
+    ((Corpus_Writer *)data)->flush();
+}
+
+void add_level_consumer(Level_Stream *stream, Level_Consume_Proc consume, Level_Flush_Proc flush, void *data) {
+    assert(!stream->writer.joinable(), "consumers are added before the stream starts");
+    stream->consumers.add(Level_Consumer{consume, flush, data});
+}
+
+void start_level_stream(Level_Stream *stream, isize queue_count) {
+    release_assert(queue_count >= 1);
+    stream->queues = make_array<Level_Queue>(queue_count);
+    for_range(i, 0, queue_count) {
+        stream->queues[i] = make_level_queue();
+    }
+    stream->stop = 0;
+    stream->written = 0;
+    stream->failed = 0;
+    stream->dropped = 0;
+    stream->time_start = get_time();
+    stream->writer = std::thread([stream]() {
+        init_thread_allocators();
+        while(true) {
+            // every level pushed before stop has been set is visible after reading it
+            bool stopping = atomic_load_acquire(&stream->stop);
+            if(consume_queued_levels(stream)) {
+                for_range(c, 0, stream->consumers.count) {
+                    auto &consumer = stream->consumers[c];
+                    if(consumer.flush) consumer.flush(consumer.data);
+                }
+                if(stream->blocking) {
+                    {
+                        std::lock_guard<std::mutex> lock(stream->mutex);
+                    }
+                    stream->space.notify_all();
+                }
+            } else if(stopping) {
+                break;
+            } else {
+                std::unique_lock<std::mutex> lock(stream->mutex);
+                stream->wake.wait(lock, [&]() {
+                    return atomic_load_acquire(&stream->stop) || has_queued_levels(stream);
+                });
+            }
+        }
+        destroy_thread_allocators();
+    });
+}
+
+bool start_level_stream(Level_Stream *stream, const char *path, isize queue_count, Level_Format format) {
+    stream->format = format;
+    if(format == Level_Format::Corpus) {
+        if(!open_corpus_writer(&stream->corpus, path)) {
+            return false;
+        }
+        add_level_consumer(stream, write_corpus_level, flush_corpus, &stream->corpus);
+    } else {
+        stream->file = fopen(path, "w");
+        if(!stream->file) {
+            println("couldn't open", path);
+            return false;
+        }
+        add_level_consumer(stream, write_text_level, flush_text_file, stream->file);
+    }
+    start_level_stream(stream, queue_count);
+    return true;
+}
+
+bool stop_level_stream(Level_Stream *stream) {
+    {
+        std::lock_guard<std::mutex> lock(stream->mutex);
+        atomic_store_release(&stream->stop, 1);
+    }
+    stream->wake.notify_one();
+    stream->writer.join();
+    stream->dropped = 0;
+    for_range(i, 0, stream->queues.count) {
+        if(stream->queues[i].dropped > 0) {
+            println("level stream dropped", stream->queues[i].dropped, "levels of queue", i, "(it was full)");
+        }
+        stream->dropped += stream->queues[i].dropped;
+        stream->queues[i].destroy();
+    }
+    stream->queues.destroy();
+    stream->consumers.destroy();
+    if(stream->failed > 0) {
+        println("level stream couldn't hand over", stream->failed, "levels");
+    }
+    bool ok = stream->failed == 0;
+    if(stream->file) {
+        ok = !ferror(stream->file) && ok;
+        ok = (fclose(stream->file) == 0) && ok;
+        stream->file = nullptr;
+    } else if(stream->corpus.file) {
+        ok = close_corpus_writer(&stream->corpus) && ok;
+    }
+    return ok;
+}
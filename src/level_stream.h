@@ -0,0 +1,108 @@
+#ifndef LEVEL_STREAM_H
+#define LEVEL_STREAM_H
+
+#include "util.h"
+#include "sokoban.h"
+#include "level_corpus.h"
+#include <stdio.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/*
+    Single producer single consumer ring of levels.
+    head is only written by the consumer, tail only by the producer; both only grow,
+    the slot of a position is position & (capacity - 1).
+    What happens with a level when the queue is full is up to the producer (see Level_Stream::publish).
+    The grids of the levels belong to the queue until they are popped.
+*/
+struct Stream_Level {
+    Level level;
+    u64 seed; // of the search that found the level
+};
+struct Level_Queue {
+    Stream_Level *slots = nullptr;
+    i64 capacity = 0; // power of 2
+    // head and tail on their own cache lines
+    u8 _padding_0[64];
+    i64 head = 0;
+    u8 _padding_1[64 - sizeof(i64)];
+    i64 tail = 0;
+    i64 dropped = 0; // producer only, see Level_Stream::publish
+    u8 _padding_2[64 - 2*sizeof(i64)];
+
+    // producer; returns false if the queue is full
+    bool push(const Stream_Level &);
+    bool full() const {
+        return tail - atomic_load_acquire(&head) == capacity;
+    }
+    bool empty() const {
+        return atomic_load_acquire(&tail) == head;
+    }
+    // consumer; returns false if the queue is empty
+    bool pop(Stream_Level *);
+    void destroy();
+};
+Level_Queue make_level_queue(isize capacity = 256);
+
+/*
+    Publishes the levels of running searches as soon as they are found (see Mcts::add_finished_level).
+    Every producing tree has its own queue (tree i of run_mcts_timeout_root_parallel uses queue i),
+    a shared tree only publishes under its level_lock so it's still a single producer.
+    The writer thread hands the levels to the registered consumers, e.g. the one of start_level_stream with
+    a path which appends them to a file in the format of save_level_set or to a level corpus (see level_corpus.h).
+    It sleeps on a condition variable while the queues are empty.
+*/
+enum class Level_Format : u8 {
+    Text,
+    Corpus,
+};
+// Called on the writer thread for every level, the grid still belongs to the stream.
+// Returns false if the level couldn't be taken (e.g. a failed write), see Level_Stream::failed.
+typedef bool(*Level_Consume_Proc)(void *, Stream_Level &);
+// Called after a batch of levels, e.g. to flush a file. Can be null.
+typedef void(*Level_Flush_Proc)(void *);
+struct Level_Consumer {
+    Level_Consume_Proc consume;
+    Level_Flush_Proc flush;
+    void *data;
+};
+struct Level_Stream {
+    Array<Level_Queue> queues;
+    Array<Level_Consumer> consumers;
+    // false: publish drops a level if its queue is full, a search never waits on the consumers
+    // true:  publish waits for a free slot, nothing gets lost (e.g. batch generation)
+    bool blocking = false;
+    // the file of start_level_stream with a path
+    Level_Format format = Level_Format::Text;
+    FILE *file = nullptr;
+    Corpus_Writer corpus;
+    std::thread writer;
+    // wake wakes the writer when there are levels or stop is set, space wakes blocked producers
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable space;
+    i64 stop = 0;
+    // written by the writer thread, read them after stop_level_stream
+    i64 written = 0; // levels every consumer took
+    i64 failed = 0;  // levels a consumer failed on
+    i64 dropped = 0; // levels publish dropped, set by stop_level_stream
+    Chrono_Clock time_start;
+    Chrono_Clock time_first_level;
+
+    // producer of the queue; the grid gets cloned.
+    // Returns false if the level has been dropped since the queue is full (only if not blocking).
+    bool publish(isize queue, Grid &, i32 box_count, f64 score, u64 seed = 0);
+};
+// Before the stream is started
+void add_level_consumer(Level_Stream *, Level_Consume_Proc, Level_Flush_Proc, void *data);
+// Starts the writer thread for the registered consumers
+void start_level_stream(Level_Stream *, isize queue_count);
+// Opens path, adds a consumer which writes to it and starts the writer thread.
+// A text file is overwritten, a corpus is continued. Returns false if the file can't be opened.
+bool start_level_stream(Level_Stream *, const char *path, isize queue_count, Level_Format = Level_Format::Text);
+// Hands the remaining levels to the consumers, joins the writer and closes the file.
+// The producers must have stopped. Returns false if a consumer failed or the file couldn't be written completely.
+bool stop_level_stream(Level_Stream *);
+
+#endif // LEVEL_STREAM_H
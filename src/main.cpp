@@ -6,6 +6,7 @@
 #include "malloc.h"
 #include "allocator.h"
 #include "experiment.h" // Includes example_levels and app
+#include "generate.h"
 
 
 Game game = {};
@@ -20,16 +21,56 @@ Mcts *make_custom_level();
 int main(int arg_count, char **args) {
 	print_and_check_settings();	
 	// uct_tests(); return 0;	
-	Default_Allocator default_allocator;
-	global_default_allocator = &default_allocator;	
-	global_allocator = global_default_allocator;
+	init_thread_allocators();
 
-	#if ARENA_ALLOCATOR
-	auto arena_allocator = make_arena_allocator(global_default_allocator);
-	global_arena_allocator = &arena_allocator;
-	#endif // ARENA_ALLOCATOR
+	// Headless batch generation: prog generate ... (see generate.h)
+	if(arg_count >= 2 && String(args[1]) == String("generate")) {
+		int result = run_generate(args, arg_count);
+		free_globals();
+		return result;
+	}
+	// prog convert in out between the text format and level corpora (see generate.h)
+	if(arg_count >= 2 && String(args[1]) == String("convert")) {
+		int result = run_convert(args, arg_count);
+		free_globals();
+		return result;
+	}
 
-	auto arg_string = scan_args(args, arg_count);
+	// prog --name value ... overwrites the settings of the search (see config.h).
+	// --checkpoint path saves the search at its end or at SIGINT/SIGTERM, --resume path continues
+	// a saved one (see mcts_checkpoint.cpp).
+	Mcts_Config config = default_mcts_config();
+	String arg_string = {};
+	const char *checkpoint_path = nullptr;
+	const char *resume_path = nullptr;
+	if(arg_count >= 2 && args[1][0] == '-') {
+		bool ok = true;
+		for(int i = 1; ok && i < arg_count; i += 2) {
+			if(i+1 >= arg_count) {
+				println("missing value for", args[i]);
+				ok = false;
+			} else if(String(args[i]) == String("--checkpoint")) {
+				checkpoint_path = args[i+1];
+			} else if(String(args[i]) == String("--resume")) {
+				resume_path = args[i+1];
+			} else {
+				ok = parse_mcts_config_arg(&config, args[i], args[i+1]);
+			}
+		}
+		if(!ok || !check_mcts_config(config)) {
+			free_globals();
+			return 1;
+		}
+		// the random engines of the search have to be the ones of this thread
+		if((checkpoint_path || resume_path) && (get_thread_count() > 1 || MCTS_BOOTSTRAP || TRACK_DATA)) {
+			println("--checkpoint and --resume need THREAD_COUNT 1 without MCTS_BOOTSTRAP and TRACK_DATA");
+			free_globals();
+			return 1;
+		}
+	} else {
+		arg_string = scan_args(args, arg_count);
+	}
+	print_mcts_config(config);
 	init_basic();
 
 	// CHECK FOR MEMORY LEAKS
@@ -78,12 +119,55 @@ int main(int arg_count, char **args) {
 		test_level_set_derive_values(game);
 		return 0;	
 	}	
+	// Compares the vectorized area score with the scalar one on random grids
+	if constexpr(false) {
+		test_area_score_simd(100000);
+		return 0;
+	}
+	// Compares the incrementally updated grid hashes with the full computation
+	if constexpr(false) {
+		test_grid_hash(10000);
+		return 0;
+	}
+	// Selection through a Decision_Proc against the inlined policies
+	if constexpr(false) {
+		benchmark_best_child(32, 1000000);
+		return 0;
+	}
+	// Selection and backup on trees of growing size
+	if constexpr(false) {
+		benchmark_descent(1000000, 20000);
+		return 0;
+	}
+	// Writes random levels to a corpus and reads them back
+	if constexpr(false) {
+		test_level_corpus(100000, "saved_levels/test_level_corpus.corpus");
+		return 0;
+	}
+	// Saves a search, loads it again and compares both continuations
+	if constexpr(false) {
+		test_checkpoint(200000, "saved_levels/test_checkpoint.bin");
+		return 0;
+	}
 
 	
 
 	Mcts *mcts;
-	mcts = new_mcts(DEFAULT_SEED, DEFAULT_BOARD_SIZE, DEFAULT_START_POSITION);
-	const i32 SIM_COUNT = SIMULATION_COUNT;
+	if(resume_path) {
+		mcts = load_mcts_checkpoint(resume_path);
+		if(!mcts) {
+			free_globals();
+			return 1;
+		}
+		// the saved settings stay, only the length of the run comes from the arguments
+		mcts->config.timeout = config.timeout;
+		mcts->config.simulation_count = config.simulation_count;
+		config = mcts->config;
+		println("resuming", resume_path, "after", mcts->root->rollout_count, "rollouts");
+	} else {
+		mcts = new_mcts(DEFAULT_SEED, config);
+	}
+	const i32 SIM_COUNT = config.simulation_count;
 	
 	const isize TO_KB = 1000;
 	const isize TO_MB = 1000*TO_KB;
@@ -93,17 +177,27 @@ int main(int arg_count, char **args) {
 		
 		
 		println("Using Seed", mcts->seed);		
-		mcts->start();
+		if(checkpoint_path) {
+			stop_runs_on_signal();
+		}
 
 		// The decision procedure that is being used in the tree_policy.
-		Decision_Proc decision_proc = node_ucb1_tuned;
+		Decision_Proc decision_proc = get_decision_proc(config.decision);
+		#if STREAM_LEVELS
+		// Levels are written to the file while searching, one queue per thread
+		Level_Stream level_stream;
+		char stream_path[256];
+		snprintf(stream_path, sizeof(stream_path), "saved_levels/stream_%llu.txt", (unsigned long long)mcts->seed);
+		release_assert(start_level_stream(&level_stream, stream_path, get_thread_count()), "couldn't open the level stream file");
+		mcts->stream = &level_stream;
+		#endif // STREAM_LEVELS
 		Chrono_Clock point_start;
 		// We have to use preprocessors because msvc(windows) doesn't have mallinfo2.
 		#if TRACK_DATA == false 
 		{
 			point_start = get_time();
 			// no timeout
-			if(DEFAULT_TIMEOUT == 0) {
+			if(config.timeout == 0) {
 				#if MCTS_BOOTSTRAP == true
 				crash("Bootstrapping is not available without a timeout.\n Make sure to set the Timeout in settings.h");
 				#else 
@@ -111,9 +205,17 @@ int main(int arg_count, char **args) {
 				#endif // MCTS_BOOTSTRAP
 			} else {
 				#if MCTS_BOOTSTRAP == true
-				auto counter = run_mcts_timeout_and_bootstrap(&mcts, decision_proc, DEFAULT_TIMEOUT, true, true, true);
+				auto counter = run_mcts_timeout_and_bootstrap(&mcts, decision_proc, config.timeout, true, true, true);
 				#else
-				auto counter = run_mcts_timeout(mcts, decision_proc, DEFAULT_TIMEOUT);
+				i64 counter;
+				auto thread_count = get_thread_count();
+				if(thread_count > 1 && TREE_PARALLEL) {
+					counter = run_mcts_timeout_tree_parallel(mcts, decision_proc, config.timeout, thread_count);
+				} else if(thread_count > 1) {
+					counter = run_mcts_timeout_root_parallel(mcts, decision_proc, config.timeout, thread_count);
+				} else {
+					counter = run_mcts_timeout(mcts, decision_proc, config.timeout);
+				}
 				#endif // MCTS_BOOTSTRAP
 				println("Simulation Count: ", counter);
 				
@@ -124,6 +226,7 @@ int main(int arg_count, char **args) {
 			// This part is used for tracking the data usage for the paper
 			// See the part before this for a normal process.
 			println("track data");
+			mcts->start();
 			
 			Array<Tracking_Data> tracking_data;
 			tracking_data.resize(SIM_COUNT);
@@ -144,9 +247,32 @@ int main(int arg_count, char **args) {
 		}
 		#endif // TRACK_DATA	
 		auto point_end = get_time();
+		#if STREAM_LEVELS
+		if(!stop_level_stream(&level_stream)) {
+			println("couldn't write every streamed level to", stream_path);
+		}
+		mcts->stream = nullptr;
+		println("streamed levels:", level_stream.written, "to", stream_path);
+		if(level_stream.written > 0) {
+			println("first streamed level after:", time_diff(level_stream.time_start, level_stream.time_first_level));
+		}
+		#endif // STREAM_LEVELS
+		if(g_stop_requested) {
+			println("stopped after", mcts->root->rollout_count, "rollouts");
+		}
+		if(checkpoint_path && save_mcts_checkpoint(mcts, checkpoint_path)) {
+			println("saved the search to", checkpoint_path);
+		}
 
 		print_children(mcts->root);		
 		println("allocated: ", get_malloc_allocation_size()/1000, "MB");
+		if(mcts->prune_count > 0) {
+			println("memory budget prunes:", mcts->prune_count, "| freed nodes:", mcts->pruned_node_count);
+		}
+		// only the rollouts on cloned nodes use the arena
+		if(config.arena_allocator && !config.scratch_rollout) {
+			print_arena_stats(get_arena_stats());
+		}
 		println("mcts duration: ", time_diff(point_start, point_end));
 		game.level_set.set(mcts->get_level_set(LEVEL_SET_SIZE));
 		// assert(mcts->root->rollout_count == SIM_COUNT);
@@ -296,9 +422,7 @@ int main(int arg_count, char **args) {
 	game.destroy();
 	delete_mcts(mcts);
 	
-	#if ARENA_ALLOCATOR
-	arena_allocator.destroy();
-	#endif // ARENA_ALLOCATOR
+	destroy_thread_allocators();
 
 	println("all good\n");
 	return 0;
@@ -306,23 +430,12 @@ int main(int arg_count, char **args) {
 
 void print_and_check_settings() {
 	// if this fails to compile it means someone removed '{}' from these settings
-	auto size = Vector2i DEFAULT_BOARD_SIZE;
-	auto start = Vector2i DEFAULT_START_POSITION;
-	release_assert(size.x>=0 && size.y>=0 && 16<=size.x*size.y && size.x*size.y<=254, "bad level size: see settings.h!");
-	if(start.x != -1) {
-		release_assert(start.x>=0 && start.y>=0, "for the default start position set it to (-1, *): see settings.h!");
-		release_assert(start.x < size.x && start.y < size.y, "start position must be inside the level");
-	}
+	// the rest is checked and printed with the config (see main)
+	release_assert(check_mcts_config(default_mcts_config()), "see settings.h!");
 	release_assert(0.0 <= MCTS_BOOTSTRAP_DELTA && MCTS_BOOTSTRAP_DELTA <= 1.0, "bootstrap delta must be in [0,1]");
-	release_assert(BOX_UPPER_CUTOFF != 0, "upper box cutoff can't be 0");
 	release_assert(LEVEL_SET_SIZE > 0, "level set size must be greater than 0");
-	println("box cutoff:", "[", BOX_LOWER_CUTOFF, BOX_UPPER_CUTOFF,"]");
-	println("depth cutoff:", DEPTH_LOWER_CUTOFF);
-	println("remove impossible:", REMOVE_IMPOSSIBLE);
-	println("arena allocator:", ARENA_ALLOCATOR);
 	println("bootstrap, count, delta:", MCTS_BOOTSTRAP, ",", MCTS_BOOTSTRAP_COUNT, ",", MCTS_BOOTSTRAP_DELTA);
-	println("enhanced move agent:", !USE_SIMPLE_MOVES);
-	println("level size", Vector2i DEFAULT_BOARD_SIZE);
+	println("threads, shared tree:", THREAD_COUNT, ",", TREE_PARALLEL);
 
 
 }
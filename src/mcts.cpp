@@ -2,22 +2,47 @@
 #include "mcts_actions.h"
 #include "allocator.h"
 #include "settings.h"
+#include "transposition.h"
+#include "level_stream.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
 
 Mcts_Node *bloom_and_check_expand(Mcts_Node *, Mcts *);
 
-void uct_body(Mcts *tree, const Decision_Proc decision) {
+template<typename Policy>
+Mcts_Node *tree_policy(Mcts_Node *, Mcts *, Policy);
+
+template<typename Policy>
+f64 uct_body(Mcts *tree, Policy decision) {
+    Allocator *previous_allocator = set_allocator(tree->node_allocator);
     auto node = tree_policy(tree->root, tree, decision);
+    set_allocator(previous_allocator);
+    tree->last_rollout_depth = node->depth;
     f64 score = default_policy(node, tree);
     node->add_score_and_propagate(score);    
+    return score;
 }
-f64 experiment_rollout(Mcts *tree, const Decision_Proc decision) {
-    auto node = tree_policy(tree->root, tree, decision);
-    f64 score = default_policy(node, tree);
-    node->add_score_and_propagate(score);    
+f64 uct_body(Mcts *tree, const Decision_Proc decision) {
+    f64 score;
+    with_decision_policy(decision, [&](auto policy) {
+        score = uct_body(tree, policy);
+    });
     return score;
 }
+// A rollout like next_rollout (the DAG of a transposition table needs the backup along the path)
+f64 experiment_rollout(Mcts *tree, const Decision_Proc decision) {
+    if(tree->transpositions) {
+        return uct_body_transposition(tree, decision);
+    }
+    return uct_body(tree, decision);
+}
 
-Mcts_Node *tree_policy(Mcts_Node *node, Mcts *tree, const Decision_Proc decision) {
+template<typename Policy>
+Mcts_Node *tree_policy(Mcts_Node *node, Mcts *tree, Policy decision) {
 
     while( !(node->flags & MCTS_TERMINAL)) {
         if(!is_bloomed(node)) {
@@ -27,10 +52,12 @@ Mcts_Node *tree_policy(Mcts_Node *node, Mcts *tree, const Decision_Proc decision
         } else {
             if(node->can_expand()) {
                 #if TREE_POLICY_NEXT == true
-                    return expand_next(node, tree);
+                    auto child = expand_next(node, tree);
                 #else 
-                    return expand_random(node, tree);
+                    auto child = expand_random(node, tree);
                 #endif
+                add_child_stats(node);
+                return child;
             }
             node = best_child(node, tree, decision);
         }
@@ -38,34 +65,78 @@ Mcts_Node *tree_policy(Mcts_Node *node, Mcts *tree, const Decision_Proc decision
     
     return node;    
 }
+// Scores the terminal node of a simulation and adds its level
+static f64 finish_rollout(Mcts_Node *node, Mcts *tree) {
+    f64 score = score_node(*node, tree);    
+    if(TREE_PARALLEL) tree->level_lock.lock();
+    // Levels which have been found before (or a rotation/reflection of them) are skipped
+    if(score > tree->best_score) {
+        #if EXPERIMENTS
+        bool added = tree->add_finished_level(node->grid, node->box_count, score, get_time());
+        #else
+        bool added = tree->add_finished_level(node->grid, node->box_count, score);
+        if(added && !tree->quiet) {
+            println("new best (score | time):", score, time_diff(tree->time_start, get_time()));
+        }
+        #endif 
+        if(added) {
+            tree->best_score = score;
+        }
+    } else if(tree->config.add_good_levels && score >= tree->config.good_level_cut) {
+
+        #if EXPERIMENTS
+        tree->add_finished_level(node->grid, node->box_count, score, get_time());
+        #else
+        bool added = tree->add_finished_level(node->grid, node->box_count, score);
+        if(added && PRINT_NEW_LEVEL_INFO && !tree->quiet) {
+            println("new good level:", score);
+        }
+        #endif 
+    }
+    if(TREE_PARALLEL) tree->level_lock.unlock();
+    return score;
+}
 f64 default_policy(Mcts_Node *base, Mcts *tree) {    
-    tree->last_rollout_depth = base->depth;
     if(base->flags & MCTS_TERMINAL) {
         return score_node(*base, tree);
     }
-    assert(base->children.count == 0);
-    
+    if(tree->config.scratch_rollout) {
+        Mcts_Node *node = rollout_in_place(base, tree);
+        #if MCTS_BOOTSTRAP
+        if(!node) {
+            return 0;
+        }
+        #endif // MCTS_BOOTSTRAP
+        assert(node);
+        return finish_rollout(node, tree);
+    }
     
-    #if ARENA_ALLOCATOR
-    global_arena_allocator->clear_arena();
-    global_allocator = global_arena_allocator;
-    #endif // ARENA_ALLOCATOR
+    // The whole simulation is given back at once by clearing the arena with the next rollout
+    const bool arena = tree->config.arena_allocator;
+    Allocator *previous_allocator = nullptr;
+    if(arena) {
+        global_arena_allocator->clear_arena();
+        previous_allocator = set_allocator(global_arena_allocator);
+    }
 
-    Mcts_Node _node;
     // simulation on a cloned node
-    clone_mcts_node(_node, base);
-    _node.parent = nullptr;
-    //assert(_node.moves.data != base->moves.data);
-    assert(_node.moves.count == base->moves.count);
+    // In a shared tree another thread might bloom base in the meantime.
+    if(TREE_PARALLEL) base->lock.lock();
+    assert(base->children.count == 0 || TREE_PARALLEL);
+    Mcts_Node *_node = clone_mcts_node(base);
+    if(TREE_PARALLEL) base->lock.unlock();
+    _node->parent = nullptr;
     if_debug {
-        for_range(i, 0, _node.moves.count) {
-            assert(_node.moves[i].index == base->moves[i].index);
+        if(base->flags & MCTS_SECOND_ACTION) {
+            assert(_node->moves().count == base->moves().count);
+            for_range(i, 0, _node->moves().count) {
+                assert(_node->moves()[i].index == base->moves()[i].index);
+            }
         }
     }
-    assert(_node.children.data == nullptr);
-    assert(_node.children.count == base->children.count);
+    assert(_node->children.data == nullptr);
 
-    Mcts_Node *node = &_node;
+    Mcts_Node *node = _node;
 
     // Mcts_Node *_debug_base_copy = &_node;
 
@@ -80,68 +151,91 @@ f64 default_policy(Mcts_Node *base, Mcts *tree) {
         }
     }
 
-    #if ARENA_ALLOCATOR
-    global_allocator = global_default_allocator;
-    #endif // ARENA_ALLOCATOR
+    if(arena) {
+        set_allocator(previous_allocator);
+    }
 
     #if MCTS_BOOTSTRAP
     if(!node) {
-        #if ARENA_ALLOCATOR == false
-        _node.destroy();
-        #endif // ARENA_ALLOCATOR
+        if(!arena) {
+            _node->destroy();
+            mem_free(_node);
+        }
         return 0;
     }
     #endif // MCTS_BOOTSTRAP
 
-    f64 score = score_node(*node, tree);    
-    if(score > tree->best_score) {
-        #if EXPERIMENTS
-        tree->finished_nodes.add(make_level(node->grid, node->box_count, score, get_time()));
-        #else
-        println("new best (score | time):", score, time_diff(tree->time_start, get_time()));
-        tree->finished_nodes.add(make_level(node->grid, node->box_count, score));
-        #endif 
-        tree->best_score = score;
-    } else if( ADD_GOOD_LEVELS && score >= GOOD_LEVEL_CUT) {
+    f64 score = finish_rollout(node, tree);
 
-        #if EXPERIMENTS
-        tree->finished_nodes.add(make_level(node->grid, node->box_count, score, get_time()));
-        #else
-        if constexpr(PRINT_NEW_LEVEL_INFO) {
-            println("new good level:", score);
-        }
-        tree->finished_nodes.add(make_level(node->grid, node->box_count, score));
-        #endif 
+    if(!arena) {
+        _node->destroy();
+        mem_free(_node);
     }
 
-    #if ARENA_ALLOCATOR == false
-    _node.destroy();
-    #endif // ARENA_ALLOCATOR
-
     return score;
 }
 void Mcts_Node::add_score_and_propagate(f64 score) {
-    rollout_count += 1;
-    score_sum += score;
-
-    #ifdef USE_SQUARED_SUM
     auto squared = score*score;
-    squared_score_sum += squared;
-    #endif // USE_SQUARED_SUM
-    
-    for(auto node = parent; node; node = node->parent) {
-        node->score_sum += score;
-        node->rollout_count += 1;
+    for(auto node = this; node; node = node->parent) {
+        add_node_stats(node, score, squared, 1);
+    }
+}
+
+// Upper bound of the children node can still get
+inline isize remaining_expansions(Mcts_Node *node) {
+    if(node->flags & MCTS_SECOND_ACTION) {
+        return node->moves().count + !(node->flags & MCTS_EVALUATED);
+    }
+    return node->first_set().count() + node->second_set().count() + node->can_freeze();
+}
 
-        #ifdef USE_SQUARED_SUM
-        node->squared_score_sum += squared;
-        #endif // USE_SQUARED_SUM
+void add_child_stats(Mcts_Node *node, bool edge) {
+    assert(node->children.count > 0);
+    auto &stats = node->child_stats;
+    isize index = node->children.count - 1;
+    if(index >= stats.capacity) {
+        isize capacity = max<isize>(2 * stats.capacity, 4);
+        // A shared tree must not move the block while the slots of other children are being updated,
+        // the first block has room for every child the node can still get.
+        if(TREE_PARALLEL) {
+            assert(stats.capacity == 0);
+            capacity = max<isize>(capacity, node->children.count + remaining_expansions(node));
+        }
+        Child_Stats grown = {};
+        grown.data = (f64 *)mem_alloc(capacity, CHILD_STATS_SLOT_SIZE);
+        release_assert(grown.data, "child stats out of memory");
+        grown.capacity = i32(capacity);
+        if(stats.capacity > 0) {
+            memcpy(grown.score_sum(), stats.score_sum(), index * sizeof(f64));
+            memcpy(grown.squared_score_sum(), stats.squared_score_sum(), index * sizeof(f64));
+            memcpy(grown.rollout_count(), stats.rollout_count(), index * sizeof(i32));
+            mem_free(stats.data);
+        }
+        stats = grown;
+    }
+    Mcts_Node *child = node->children[index];
+    if(edge) {
+        assert(!(child->flags & MCTS_SECOND_ACTION) && child->child_index < 0);
+        stats.set(index, 0, 0, 0);
+        return;
     }
+    assert(child->parent == node && child->child_index < 0);
+    stats.set(index, child->score_sum, child->squared_score_sum, child->rollout_count);
+    child->child_index = i32(index);
 }
 
 void prune_node(Mcts_Node *node) {
     auto parent = node->parent;
     assert(parent);
+    if(node->child_index >= 0) {
+        // the slots behind it move to the front like the children
+        auto &stats = parent->child_stats;
+        for_range(i, node->child_index, parent->children.count - 1) {
+            stats.set(i, stats.score_sum()[i+1], stats.squared_score_sum()[i+1], stats.rollout_count()[i+1]);
+            assert(parent->children[i+1]->child_index == i+1);
+            parent->children[i+1]->child_index = i32(i);
+        }
+    }
     parent->children.remove_match(node);
     node->destroy();
     mem_free(node);
@@ -187,55 +281,31 @@ Mcts_Node *bloom_and_check_expand(Mcts_Node *node, Mcts *tree) {
 
 
 
-Mcts_Node *best_child(Mcts_Node *node, Mcts *tree, const Decision_Proc decision) {
-    f64 max_val = F64_MIN;
-    isize arg = -1;
-    assert(node->children.count > 0);
-    for_range(i, 0, node->children.count) {
-        Mcts_Node *it = node->children[i];
-        f64 val = decision(it);
-        if(val > max_val) {                
-            max_val = val;
-            arg = i;
-        }        
-    }
-    if_debug {
-        if(arg<0) {
-            println(str(node->grid));
-            for_range(i, 0, node->children.count) {
-                Mcts_Node *it = node->children[i];
-                println(it->score_sum, it->squared_score_sum, it->parent->rollout_count, it->rollout_count);
-                f64 val = decision(it);
-                println(val);
-            }            
-        }
-    }
-    assert(arg >= 0);
-    return node->children[arg]; 
-}
+// The moves of a bloom are collected here before the node gets its own array (see action_move_agent).
+// One buffer per thread since the threads of a shared tree bloom at the same time.
+thread_local Move_Info bloom_move_buffer[MAX_MOVE_COUNT];
+
 void bloom(Mcts_Node *node, Mcts *tree) {
     assert(!(node->flags & MCTS_EXPANDED) && !(node->flags & MCTS_BLOOMED) && !(node->flags & MCTS_TERMINAL));
     if(node->flags & MCTS_SECOND_ACTION) {
-        action_move_agent(*node, tree);
+        Array<Move_Info> scratch = {MAX_MOVE_COUNT, 0, bloom_move_buffer};
+        action_move_agent(*node, tree, scratch);
         // No action_evaluate since there is no special requirement to it besides being frozen.
         // For a comment on that see *bloom_and_check_expand*.
     } else {
         action_delete_obstacle(*node, tree);
         action_place_box(*node, tree);
-        action_freeze(*node);
+        action_freeze(*node, tree);
     }
     node->flags |= MCTS_BLOOMED;
 }
 
-Mcts_Node *expand_random(Mcts_Node *node, Mcts *tree) {
-    assert(!(node->flags & MCTS_TERMINAL) && (node->flags&MCTS_BLOOMED));
-    assert(node->can_expand());
-    i64 A_COUNT = node->children.count;
+Mcts_Action pick_random_action(Mcts_Node *node, isize move_count) {
     // Getting randomly the next child is a bit complicated since one
     // has to combine the expansion information.
     if(node->flags & MCTS_SECOND_ACTION) {
         bool e = !(node->flags&MCTS_EVALUATED);
-        bool m = (node->moves.count > 0);
+        bool m = (move_count > 0);
         
 
         assert(m | e);
@@ -243,41 +313,50 @@ Mcts_Node *expand_random(Mcts_Node *node, Mcts *tree) {
             new_move_agent(*node, tree);
         } else */
         if(m && e) {
-            auto r = randi_range(0, node->moves.count);
+            auto r = random_index(move_count+1);
             if(r == 0) {
-                new_evaluate_level(*node, tree);
-            } else {
-                new_move_agent(*node, tree);
-                
+                return Mcts_Action::Evaluate_Level;
             }
+            return Mcts_Action::Move_Agent;
         } else if(m) {
-            new_move_agent(*node, tree);
-        } else {
-            new_evaluate_level(*node, tree);
+            return Mcts_Action::Move_Agent;
         }
-        
-    } else {
-        bool f = node->can_freeze();
-        bool d = (node->first.count > 0);
-        bool p = (node->second.count > 0);
-
-        assert(d | p | f);
+        return Mcts_Action::Evaluate_Level;
+    }
+    bool f = node->can_freeze();
+    isize first_count = node->first_set().count();
+    isize second_count = node->second_set().count();
+    bool d = (first_count > 0);
+    bool p = (second_count > 0);
+
+    assert(d | p | f);
+
+    auto r = random_index(first_count+second_count+1);
+    if(f && (r == 0)) {
+        return Mcts_Action::Freeze_Level;
+    } else if(d && p) {
+        if(r <= first_count) {
+            return Mcts_Action::Delete_Obstacle;
+        }
+        return Mcts_Action::Place_Box;
+    } else if(d) {
+        return Mcts_Action::Delete_Obstacle;
+    }
+    assert(p);
+    return Mcts_Action::Place_Box;
+}
 
-        auto r = randi_range(0, node->first.count+node->second.count);
-        if(f && (r == 0)) {
-            new_freeze_level(*node, tree);
-        } else if(d && p) {
-            if(r <= node->first.count) {
-                new_delete_obstacle(*node, tree);
-            } else {
-                new_place_box(*node, tree); 
-            }
-        } else if(d) {
-            new_delete_obstacle(*node, tree);
-        } else {
-            assert(p);
-            new_place_box(*node, tree);
-        } 
+Mcts_Node *expand_random(Mcts_Node *node, Mcts *tree) {
+    assert(!(node->flags & MCTS_TERMINAL) && (node->flags&MCTS_BLOOMED));
+    assert(node->can_expand());
+    i64 A_COUNT = node->children.count;
+    isize move_count = (node->flags & MCTS_SECOND_ACTION) ? node->moves().count : 0;
+    switch(pick_random_action(node, move_count)) {
+        case Mcts_Action::Delete_Obstacle: new_delete_obstacle(*node, tree); break;
+        case Mcts_Action::Place_Box:       new_place_box(*node, tree); break;
+        case Mcts_Action::Freeze_Level:    new_freeze_level(*node, tree); break;
+        case Mcts_Action::Move_Agent:      new_move_agent(*node, tree); break;
+        case Mcts_Action::Evaluate_Level:  new_evaluate_level(*node, tree); break;
     }
     assert(A_COUNT+1 == node->children.count);
     node->flags |= MCTS_EXPANDED;
@@ -291,7 +370,7 @@ Mcts_Node *expand_next(Mcts_Node *node, Mcts *tree) {
 
     node->flags |= MCTS_EXPANDED;
     if(node->flags & MCTS_SECOND_ACTION) {  
-        bool m = (node->moves.count > 0);
+        bool m = (node->moves().count > 0);
         bool e = !(node->flags&MCTS_EVALUATED);
         assert(m | e);
         /* if( m > 0 && node->depth <= tree->depth_soft_cutoff) {
@@ -303,8 +382,8 @@ Mcts_Node *expand_next(Mcts_Node *node, Mcts *tree) {
             return new_evaluate_level(*node, tree);
         }
     } else {
-        bool d = (node->first.count > 0);
-        bool p = (node->second.count > 0);
+        bool d = !node->first_set().is_empty();
+        bool p = !node->second_set().is_empty();
         bool f = node->can_freeze();
         assert(d | p | f);
         if(d) {
@@ -319,46 +398,85 @@ Mcts_Node *expand_next(Mcts_Node *node, Mcts *tree) {
 
 
 
-Mcts_Node make_mcts_node(Mcts_Node &parent) {
-
-    Mcts_Node node = {};
-    node.parent = &parent;
-    node.grid = clone_grid(parent.grid);
-    node.box_count = parent.box_count;
-    // println("box_count: ", parent.second.count, " : ", parent.box_count);
-    node.depth = parent.depth + 1;
-    node.pusher = parent.pusher;
-    if(parent.flags & MCTS_SECOND_ACTION) {
-        node.flags = MCTS_SECOND_ACTION;
-        node.first = clone_array(parent.first);
-        node.second = clone_array(parent.second);
+/*
+    A node is a single block:
+        the node itself
+        first phase:  the words of block_set, box_set, first_set and second_set
+        second phase: the grid data (padded to 8 bytes), moves, first_table and second_table
+    The grid and the tables aren't initialized, the sets and moves are empty.
+*/
+Mcts_Node *new_mcts_node(i32 width, i32 height, bool second_action) {
+    isize cell_count = width * height;
+    assert(cell_count <= MAX_CELL_COUNT);
+    auto node = (Mcts_Node *)mem_alloc(mcts_node_size(cell_count, second_action), 1);
+    init_mcts_node(node, width, height, second_action);
+    return node;
+}
+// node is a block of at least mcts_node_size bytes
+void init_mcts_node(Mcts_Node *node, i32 width, i32 height, bool second_action) {
+    isize size = mcts_node_size(width * height, second_action);
+    // the block is raw memory (or an old node), the node is constructed in it
+    new(node) Mcts_Node();
+    node->grid.width = width;
+    node->grid.height = height;
+    node->flags = second_action ? MCTS_SECOND_ACTION : 0;
+    if(second_action) {
+        node->grid.data = (Pawn *)(node + 1);
+        node->moves() = {};
     } else {
-        node.flags = 0;
+        node->grid.data = nullptr;
+        memset((u8 *)(node + 1), 0, size - sizeof(Mcts_Node));
     }
+}
+// If the child is the first node of the second phase (freeze) its grid is created from the bitboards
+// of the parent and its tables aren't initialized.
+Mcts_Node *make_child_node(Mcts_Node &parent, bool second_action) {
+    auto node = new_mcts_node(parent.grid.width, parent.grid.height, second_action);
+    node->parent = &parent;
+    copy_to_child_node(parent, node);
     return node;
 }
-Mcts_Node clone_mcts_node(Mcts_Node &c, Mcts_Node *node) {
-    c.parent = node->parent;
-    c.children = clone_array(node->children);
-
-    c.first = clone_array(node->first);
-    c.second = clone_array(node->second);
-    c.moves = clone_array(node->moves);
+// The state of parent without its sets, moves and flags; node comes from init_mcts_node
+void copy_to_child_node(Mcts_Node &parent, Mcts_Node *node) {
+    bool second_action = node->flags & MCTS_SECOND_ACTION;
+    if(parent.flags & MCTS_SECOND_ACTION) {
+        isize cell_count = parent.grid.get_count();
+        memcpy(node->grid.data, parent.grid.data, cell_count);
+        memcpy(node->first_table(), parent.first_table(), 2 * cell_count);
+    } else if(second_action) {
+        Bitboard board = {};
+        board.block = load_bits(parent.block_set());
+        board.box = load_bits(parent.box_set());
+        bitboard_to_grid(board, node->grid);
+    } else {
+        isize word_count = parent.block_set().word_count;
+        memcpy(node->block_set().words, parent.block_set().words, 2 * word_count * sizeof(u64));
+    }
+    node->grid.hash = parent.grid.hash;
+    node->box_count = parent.box_count;
+    node->depth = parent.depth + 1;
+    node->pusher = parent.pusher;
+}
+// The children and the statistics are not being cloned.
+Mcts_Node *clone_mcts_node(Mcts_Node *node) {
+    bool second_action = node->flags & MCTS_SECOND_ACTION;
+    auto c = new_mcts_node(node->grid.width, node->grid.height, second_action);
+    c->parent = node->parent;
 
-    c.pusher = node->pusher;
+    c->pusher = node->pusher;
     
-
-    c.grid = clone_grid(node->grid);
-    c.flags = node->flags;
-    c.score_sum = node->score_sum;
-    #ifdef USE_SQUARED_SUM
-    c.squared_score_sum  = node->squared_score_sum;
-    #endif
-    c.rollout_count = node->rollout_count;
-    c.box_count = node->box_count;
-    c.depth = node->depth;
+    memcpy(c + 1, node + 1, mcts_node_size(node->grid.get_count(), second_action) - sizeof(Mcts_Node));
+    if(second_action) {
+        c->moves() = clone_array(node->moves());
+    }
+    c->flags = node->flags;
+    c->grid.hash = node->grid.hash;
+    c->box_count = node->box_count;
+    c->depth = node->depth;
     return c;
 }
+// The grid, the bitboards and the tables are part of the node's block which is freed by the owner.
+// Not for trees with shared nodes (see mcts_transposition.cpp), the node pool frees those.
 void Mcts_Node::destroy() {
     for_range(i, 0, children.count) {
         Mcts_Node *it = children[i];
@@ -366,10 +484,13 @@ void Mcts_Node::destroy() {
         mem_free(it);
     }
     children.destroy();
-    first.destroy();
-    second.destroy();
-    moves.destroy();
-    grid.destroy();
+    if(child_stats.data) {
+        mem_free(child_stats.data);
+        child_stats = {};
+    }
+    if(flags & MCTS_SECOND_ACTION) {
+        moves().destroy();
+    }
 }
 // The terrain method from the first paper
 i32 terrain_of(Grid &grid) {
@@ -483,6 +604,93 @@ i32 area_score_of_v2(Grid &grid) {
     }
     return good_tile_count;
 }
+
+/*
+    area_score_of_v2 for a whole row at once.
+    The grid is turned into a block mask (0xff for a block, 0 otherwise) with some padding
+    around it such that the shifted loads never leave the buffer.
+    For each lane x of a row the 9 loads at y-1..y+1 and x-1..x+1 are or'ed (has block)
+    and and'ed (only blocks), the lanes past width-2 are masked off before counting.
+*/
+#if defined(__AVX2__)
+struct Area_Lanes {
+    typedef __m256i V;
+    static const i32 count = 32;
+    static force_inline V load(const u8 *p) { return _mm256_loadu_si256((const V *)p); }
+    static force_inline V or_(V a, V b) { return _mm256_or_si256(a, b); }
+    static force_inline V and_(V a, V b) { return _mm256_and_si256(a, b); }
+    static force_inline V andnot(V a, V b) { return _mm256_andnot_si256(a, b); }
+    static force_inline V is_block(V a) {
+        V bit = _mm256_set1_epi8(char(Pawn::Block));
+        return _mm256_cmpeq_epi8(_mm256_and_si256(a, bit), bit);
+    }
+    static force_inline void store(u8 *p, V a) { _mm256_storeu_si256((V *)p, a); }
+    static force_inline u32 movemask(V a) { return u32(_mm256_movemask_epi8(a)); }
+};
+#define AREA_SCORE_SIMD true
+#elif defined(__SSE2__) || defined(_M_X64)
+struct Area_Lanes {
+    typedef __m128i V;
+    static const i32 count = 16;
+    static force_inline V load(const u8 *p) { return _mm_loadu_si128((const V *)p); }
+    static force_inline V or_(V a, V b) { return _mm_or_si128(a, b); }
+    static force_inline V and_(V a, V b) { return _mm_and_si128(a, b); }
+    static force_inline V andnot(V a, V b) { return _mm_andnot_si128(a, b); }
+    static force_inline V is_block(V a) {
+        V bit = _mm_set1_epi8(char(Pawn::Block));
+        return _mm_cmpeq_epi8(_mm_and_si128(a, bit), bit);
+    }
+    static force_inline void store(u8 *p, V a) { _mm_storeu_si128((V *)p, a); }
+    static force_inline u32 movemask(V a) { return u32(_mm_movemask_epi8(a)); }
+};
+#define AREA_SCORE_SIMD true
+#else
+#define AREA_SCORE_SIMD false
+#endif
+
+i32 area_score_of_v2_simd(Grid &grid) {
+    #if AREA_SCORE_SIMD
+    typedef Area_Lanes L;
+    const isize PADDING = 64;
+    alignas(32) u8 buffer[PADDING + MAX_CELL_COUNT + PADDING];
+    const i32 width = grid.width;
+    const i32 height = grid.height;
+    const isize cell_count = grid.get_count();
+    assert(cell_count <= MAX_CELL_COUNT);
+
+    u8 *block = buffer + PADDING;
+    memset(buffer, 0, sizeof(buffer));
+    memcpy(block, grid.data, cell_count);
+    for(isize i = 0; i < cell_count; i += L::count) {
+        L::store(block + i, L::is_block(L::load(block + i)));
+    }
+
+    i32 good_tile_count = 0;
+    for_range(y, 1, height-1) {
+        for(i32 x = 1; x < width-1; x += L::count) {
+            const u8 *p = block + y*width + x;
+            const u8 *up = p - width;
+            const u8 *down = p + width;
+            typename L::V a0 = L::load(up-1),   a1 = L::load(up),   a2 = L::load(up+1);
+            typename L::V b0 = L::load(p-1),    b1 = L::load(p),    b2 = L::load(p+1);
+            typename L::V c0 = L::load(down-1), c1 = L::load(down), c2 = L::load(down+1);
+
+            auto any = L::or_(L::or_(L::or_(a0, a1), L::or_(a2, b0)), L::or_(L::or_(b1, b2), L::or_(L::or_(c0, c1), c2)));
+            auto all = L::and_(L::and_(L::and_(a0, a1), L::and_(a2, b0)), L::and_(L::and_(b1, b2), L::and_(L::and_(c0, c1), c2)));
+            u32 good = L::movemask(L::andnot(all, any));
+
+            i32 lane_count = min(L::count, width-1 - x);
+            if(lane_count < 32) {
+                good &= (u32(1) << lane_count) - 1;
+            }
+            good_tile_count += popcount(good);
+        }
+    }
+    return good_tile_count;
+    #else
+    return area_score_of_v2(grid);
+    #endif // AREA_SCORE_SIMD
+}
 // This one moves in a 3x3 block around the upper left cell.
 // While area_score_of_v2 moves around the middle cell of each block.
 // Both methods are equivalent.
@@ -655,23 +863,63 @@ i32 group_value(Mcts_Node &node) {
     return count;
 }
 
+/*
+    Summed-area table of a level for the rectangle counts of the congestion.
+    Entry (x, y) holds the counts of the cells above and left of cell (x, y) which are packed
+    into 16 bit fields (box, goal, block). A field never gets above 2*254 and never below 0,
+    so the fields can be added and subtracted together without carrying into each other.
+*/
+struct Level_Count_Table {
+    u64 data[2*MAX_CELL_COUNT];
+    i32 stride;
+
+    void init(const Grid &grid) {
+        stride = grid.width + 1;
+        assert(stride * (grid.height + 1) <= 2*MAX_CELL_COUNT);
+        for_range(x, 0, stride) {
+            data[x] = 0;
+        }
+        for_range(y, 0, grid.height) {
+            u64 *row = data + (y+1)*stride;
+            const u64 *above = row - stride;
+            row[0] = 0;
+            u64 row_sum = 0;
+            for_range(x, 0, grid.width) {
+                Pawn pawn = grid.data[y*grid.width + x];
+                row_sum += u64(pawn_is_box(pawn)) | (u64(pawn_is_goal(pawn)) << 16) | (u64(pawn_is_block(pawn)) << 32);
+                row[x+1] = above[x+1] + row_sum;
+            }
+        }
+    }
+    // counts of the rectangle spanned by the two tiles (inclusive)
+    force_inline u64 count(Vector2i a, Vector2i b) const {
+        i32 x0 = min(a.x, b.x), x1 = max(a.x, b.x) + 1;
+        i32 y0 = min(a.y, b.y), y1 = max(a.y, b.y) + 1;
+        return (data[y1*stride + x1] + data[y0*stride + x0]) - (data[y0*stride + x1] + data[y1*stride + x0]);
+    }
+};
+#define table_box_count(C)   i32((C) & 0xffff)
+#define table_goal_count(C)  i32(((C) >> 16) & 0xffff)
+#define table_block_count(C) i32(((C) >> 32) & 0xffff)
+
 // version == 1 or 2
 template <int version, bool include_box_on_goal = true>
-f64 congestion(Mcts_Node &node, Mcts *tree, const f64 ALPHA = 1.0, const f64 BETA = 1.0, const f64 GAMMA = 1.0) {
+f64 congestion(Mcts_Node &node, Mcts *, const f64 ALPHA = 1.0, const f64 BETA = 1.0, const f64 GAMMA = 1.0) {
 
     i32 goal_count;
     i32 box_count;
     i32 block_count;
 
+    // the counts inside of the rectangles are looked up instead of scanning them
+    Level_Count_Table table;
+    table.init(node.grid);
     f64 pc = 0;
     for_range(i, 0, node.grid.get_count()) {
         if(!pawn_is_box(node.grid.get(i))) continue;
-        // if(node.first[i] == INVALID_INDEX) continue;
-
-        goal_count = -1; box_count = -1; block_count = 0;
+        // if(node.first_table()[i] == INVALID_INDEX) continue;
 
         i32 box_index  = i;
-        i32 goal_index = node.second[i];
+        i32 goal_index = node.second_table()[i];
         assert(pawn_is_box(node.grid.data[box_index]));
         assert(pawn_is_goal(node.grid.data[goal_index]));
         if(box_index == goal_index) continue;
@@ -683,48 +931,20 @@ f64 congestion(Mcts_Node &node, Mcts *tree, const f64 ALPHA = 1.0, const f64 BET
         Vector2i goal = node.grid.as_tile(goal_index);
         // e.g. {1, 5} - {3, 2} = {-2, 3}
         Vector2i rect = goal - box;
-        i32 step_x;
-        if(rect.x == 0) {
-            step_x = 0;
-        } else {
-            step_x = (rect.x>0)? 1 : -1;
-        }
-
-        i32 step_y;
-        if(rect.y == 0) {
-            step_y = 0;
-        } else {
-            step_y = (rect.y>0)? 1 : -1;
-        }
 
         // Add one to each since we start at 0
         i32 count_x = abs(rect.x)+1;
         i32 count_y = abs(rect.y)+1;
-        Vector2i tile = box;
         
         // assert(!(box == goal)); // test if move_count > 0?
 
-        for_range(y, 0, count_y) {
-            tile.x = box.x;
-            for_range(x, 0, count_x) {
-                Pawn pawn = node.grid.get(tile.x, tile.y);
-                /* if(tree->start_position_tile == tile) {
-                    box_count += 1;
-                } */ if(pawn_is_goal(pawn)) {
-                    goal_count += 1;
-                } if(pawn_is_box(pawn)) {
-                    box_count += 1;
-                } else if(pawn_is_block(pawn)) {
-                    block_count += 1;
-                }
-                tile.x += step_x;
-            }
-            tile.y += step_y;
-        }
+        // the box and its goal aren't counted
+        u64 counts = table.count(box, goal);
+        goal_count  = table_goal_count(counts) - 1;
+        box_count   = table_box_count(counts) - 1;
+        block_count = table_block_count(counts);
         
         if_debug {
-            Vector2i step_vec = Vector2i{step_x, step_y};
-            assert(tile == goal+step_vec);
             if(!(goal_count >= 0 && box_count >=0)) {
                 print(str(node.grid));
                 assert(false);
@@ -765,7 +985,12 @@ f64 score_node(Mcts_Node &node, Mcts *tree) {
     }
     
 
-    f64 wb = 3, wc = 7, wn = 8, k = 55, pb = area_score_of_v2(node.grid);
+    f64 wb = 3, wc = 7, wn = 8, k = 55, pb;
+    if constexpr (SIMD_AREA_SCORE) {
+        pb = area_score_of_v2_simd(node.grid);
+    } else {
+        pb = area_score_of_v2(node.grid);
+    }
     f64 pc = congestion<2>(node, tree, 1.9, 0.1, 1.3);
     
 
@@ -810,6 +1035,18 @@ isize get_box_count(Grid &grid) {
     }
     return box_count;
 }
+// Returns a new grid with the board of the node, the first phase doesn't store one (see Mcts_Node::block_set)
+Grid get_node_grid(Mcts_Node &node) {
+    if(node.flags & MCTS_SECOND_ACTION) {
+        return clone_grid(node.grid);
+    }
+    Grid grid = make_grid(node.grid.width, node.grid.height);
+    Bitboard board = {};
+    board.block = load_bits(node.block_set());
+    board.box = load_bits(node.box_set());
+    bitboard_to_grid(board, grid);
+    return grid;
+}
 Level make_level(Grid &grid, i32 box_count, f64 score, Chrono_Clock clock) {
     Level level;
     level.grid = clone_grid(grid);
@@ -827,6 +1064,79 @@ void level_sort(Array<Level> &arr) {
     };
     std::sort(arr.data, arr.data + arr.count, p);
 }
+void Mcts::sort_finished_levels() {
+    level_sort(finished_nodes);
+}
+
+/*
+    finished_nodes is a min-heap by score of at most LEVEL_SET_SIZE levels,
+    the worst kept level is finished_nodes[0].
+    A level which isn't better than it is rejected before its grid is cloned.
+*/
+inline void level_heap_sift_up(Array<Level> &heap, isize i) {
+    while(i > 0) {
+        isize parent = (i - 1) / 2;
+        if(heap[parent].score <= heap[i].score) break;
+        swap_values(heap[parent], heap[i]);
+        i = parent;
+    }
+}
+inline void level_heap_sift_down(Array<Level> &heap, isize i) {
+    while(true) {
+        isize smallest = i;
+        isize left = 2*i + 1;
+        isize right = left + 1;
+        if(left < heap.count && heap[left].score < heap[smallest].score) smallest = left;
+        if(right < heap.count && heap[right].score < heap[smallest].score) smallest = right;
+        if(smallest == i) break;
+        swap_values(heap[smallest], heap[i]);
+        i = smallest;
+    }
+}
+// Returns false if the level (hash is its grid_symmetry_hash) is a duplicate
+// or the heap is full and the level isn't better than the worst kept one.
+// Else the worst level is dropped if the heap is full and the level has to be pushed next.
+bool Mcts::make_room_for_level(u64 hash, f64 score) {
+    bool full = finished_nodes.count >= LEVEL_SET_SIZE;
+    if(full && f32(score) <= finished_nodes[0].score) {
+        return false;
+    }
+    if(!finished_hashes.add(hash)) {
+        return false;
+    }
+    if(full) {
+        auto &worst = finished_nodes[0];
+        bool removed = finished_hashes.remove(grid_symmetry_hash(worst.grid));
+        release_assert(removed, "finished level without its hash");
+        worst.grid.destroy();
+        finished_nodes[0] = finished_nodes[finished_nodes.count - 1];
+        finished_nodes.count -= 1;
+        level_heap_sift_down(finished_nodes, 0);
+    }
+    return true;
+}
+// Takes the ownership of the grid of the level
+void Mcts::push_finished_level(Level &level) {
+    assert(finished_nodes.count < LEVEL_SET_SIZE);
+    finished_nodes.add(level);
+    level_heap_sift_up(finished_nodes, finished_nodes.count - 1);
+}
+// Adds a copy of the grid to finished_nodes unless the level or one of its rotations/reflections is in there already
+// or it isn't good enough for the heap. The copy is only made for added levels.
+bool Mcts::add_finished_level(Grid &grid, i32 box_count, f64 score, Chrono_Clock clock) {
+    if(!make_room_for_level(grid_symmetry_hash(grid), score)) {
+        return false;
+    }
+    Level level = make_level(grid, box_count, score, clock);
+    push_finished_level(level);
+    if(stream) {
+        stream->publish(stream_queue, grid, box_count, score, seed);
+    }
+    #if EXPERIMENTS
+    score_history.add(Level_Score{level.score, level.time_stamp});
+    #endif
+    return true;
+}
 Array<Level> Mcts::get_level_set(isize count) {
     println("seed used: ", this->seed);
     assert(finished_nodes.count >= 1);
@@ -852,7 +1162,7 @@ Array<Level> Mcts::get_level_set(isize count) {
         }
     }
     // array_sort(finished_nodes, level_less);
-    level_sort(finished_nodes);
+    sort_finished_levels();
     for(isize i = 0; i<count; i+=1) {
         //if(i == min_arg) continue;
         isize idx = (finished_nodes.count - count) + i;
@@ -864,44 +1174,58 @@ Array<Level> Mcts::get_level_set(isize count) {
     return final;
 }
 
-void Mcts::start() {
-    #if MT_RANDOM == true
-    set_global_random_engine_seed(this->seed);
-    #else 
-    srand(this->seed);
-    #endif
+void Mcts::start(u64 thread_index) {
+    if(resume_random && thread_index == 0) {
+        set_random_state(*resume_random);
+        mem_free(resume_random);
+        resume_random = nullptr;
+        return;
+    }
+    set_global_random_engine_seed(this->seed + thread_index);
 }
 
 f64 get_score_scale(Mcts *tree) {
     return 25.0/tree->area;
 }
+void init_mcts_from_config(Mcts &mcts, const Mcts_Config &config) {
+    mcts.config = config;
+    mcts.depth_soft_cutoff = config.depth_lower_cutoff + DEPTH_SOFT_CUTOFF;
+    mcts.size = config.size;
+    mcts.area = config.size.x * config.size.y;
+    if(config.box_upper_cutoff < 0) {
+        mcts.box_upper_cutoff = ceil(mcts.area/BOX_AREA_CUTOFF);
+    } else {
+        mcts.box_upper_cutoff = config.box_upper_cutoff;
+    }
+    mcts.score_scale = get_score_scale(&mcts);
+    mcts.shape = make_board_shape(config.size.x, config.size.y);
+}
 Mcts *new_mcts(u64 seed, Vector2i size, Vector2i start_position) {
+    auto config = default_mcts_config();
+    config.size = size;
+    config.start_position = start_position;
+    return new_mcts(seed, config);
+}
+Mcts *new_mcts(u64 seed, const Mcts_Config &config) {
     Mcts mcts = {};
-    mcts.depth_soft_cutoff = DEPTH_LOWER_CUTOFF + DEPTH_SOFT_CUTOFF;
-    mcts.finished_nodes = make_array<Level>(0, 50);
+    mcts.finished_nodes = make_array<Level>(0, LEVEL_SET_SIZE);
     mcts.time_start = get_time();
     if(seed == 0) {
         mcts.seed = std::random_device{}();
     } else {
         mcts.seed = seed;
     }
-    mcts.size = size;
-    mcts.area = size.x * size.y;
-    if(BOX_UPPER_CUTOFF < 0) {
-        mcts.box_upper_cutoff = ceil(mcts.area/BOX_AREA_CUTOFF);
-    } else {
-        mcts.box_upper_cutoff = BOX_UPPER_CUTOFF;
-    }
-    mcts.score_scale = get_score_scale(&mcts);
+    init_mcts_from_config(mcts, config);
+    auto size = config.size;
+    auto start_position = config.start_position;
+
+    mcts.node_allocator = mem_new<Pool_Allocator>();
+    *mcts.node_allocator = make_pool_allocator(global_default_allocator, node_pool_chunk_size(config));
+    Allocator *previous_allocator = set_allocator(mcts.node_allocator);
 
-    Mcts_Node* root = mem_alloc<Mcts_Node>();
-    *root = {};
+    Mcts_Node* root = new_mcts_node(size.x, size.y, false);
 
     root->parent = nullptr;
-    root->grid = make_grid(size.x, size.y);
-    for_range(i, 0, root->grid.get_count()) {
-        root->grid.data[i] = Pawn::Block;
-    }
     Vector2i mid;
     if (start_position.x < 0) {
         mid = size/2;
@@ -910,12 +1234,21 @@ Mcts *new_mcts(u64 seed, Vector2i size, Vector2i start_position) {
         assert(root->grid.in_grid(mid.x, mid.y));
     }
 
-    root->grid(mid.x, mid.y) = Pawn::Empty;
+    Bits256 block = mcts.shape.inside;
+    block.reset(root->grid.as_index(mid.x, mid.y));
+    store_bits(root->block_set(), block);
+    root->grid.hash = zobrist_hash(*root);
+    set_allocator(previous_allocator);
 
     mcts.root = root;
     mcts.start_position = root->grid.as_index(mid.x, mid.y);
     mcts.start_position_tile = mid;
     assert(mid == root->grid.as_tile(mcts.start_position));
+    #if TRANSPOSITION_TABLE
+    mcts.transpositions = mem_new<Transposition_Table>();
+    *mcts.transpositions = make_transposition_table(global_default_allocator);
+    mcts.transpositions->add(root);
+    #endif // TRANSPOSITION_TABLE
     auto ptr = mem_alloc<Mcts>();
     *ptr = mcts;
     root->pusher = (u8)mcts.start_position;
@@ -924,53 +1257,74 @@ Mcts *new_mcts(u64 seed, Vector2i size, Vector2i start_position) {
 
 void root_add_custom_child(Mcts *mcts, Grid &grid, f64 score) {
     auto node = mcts->root;
-    Mcts_Node *child = mem_alloc<Mcts_Node>();
-    *child = {};
-    child->grid = clone_grid(grid);
+    Grid level = clone_grid(grid);
+    Allocator *previous_allocator = set_allocator(mcts->node_allocator);
+    Mcts_Node *child = new_mcts_node(grid.width, grid.height, false);
     child->pusher = node->pusher;
 
     child->depth = node->depth;
     child->parent = node;
-    if(pawn_is_box(child->grid.get(child->pusher))) {
-        println(child->grid.as_tile(child->pusher));
-        println(str(child->grid));
+    if(pawn_is_box(level.get(child->pusher))) {
+        println(level.as_tile(child->pusher));
+        println(str(level));
         assert(false);
     }
-    grid_remove_goals_and_pusher(child->grid);
-    child->box_count = get_box_count(child->grid);
+    grid_remove_goals_and_pusher(level);
+    Bitboard board = make_bitboard(level);
+    store_bits(child->block_set(), board.block);
+    store_bits(child->box_set(), board.box);
+    child->box_count = board.box.count();
+    child->grid.hash = level.hash;
+    assert(child->grid.hash == zobrist_hash(*child));
     /* println(child->box_count);
-    println(str(child->grid)); */
+    println(str(level)); */
     // mcts->finished_nodes.add(make_level(grid, child->box_count, score, get_time()));
 
-    node->children.add(child);
+    if(mcts->transpositions && mcts->transpositions->find(child)) {
+        // an equal level has been added already
+        mem_free(child);
+    } else {
+        node->children.add(child);
+        if(mcts->transpositions) {
+            mcts->transpositions->add(child);
+            child->parent_count = 1;
+        }
+        add_child_stats(node, mcts->transpositions != nullptr);
+    }
+    set_allocator(previous_allocator);
+    level.destroy();
 }
 Mcts *new_mcts_bootstrap(u64 seed, Vector2i size, Vector2i start_position) {
+    auto config = default_mcts_config();
+    config.size = size;
+    config.start_position = start_position;
+    return new_mcts_bootstrap(seed, config);
+}
+Mcts *new_mcts_bootstrap(u64 seed, const Mcts_Config &config) {
+    assert(config.start_position.x >= 0);
     Mcts mcts = {};
-    mcts.depth_soft_cutoff = DEPTH_LOWER_CUTOFF + DEPTH_SOFT_CUTOFF;
-    mcts.finished_nodes = make_array<Level>(0, 50);
+    mcts.finished_nodes = make_array<Level>(0, LEVEL_SET_SIZE);
     mcts.time_start = get_time();
     mcts.seed = seed;
 
-    mcts.size = size;
-    mcts.area = size.x * size.y;
-    if(BOX_UPPER_CUTOFF < 0) {
-        mcts.box_upper_cutoff = ceil(mcts.area/BOX_AREA_CUTOFF);
-    } else {
-        mcts.box_upper_cutoff = BOX_UPPER_CUTOFF;
-    }
-    mcts.score_scale = get_score_scale(&mcts);
-    
+    init_mcts_from_config(mcts, config);
+    auto size = config.size;
+    auto start_position = config.start_position;
     
+    mcts.node_allocator = mem_new<Pool_Allocator>();
+    *mcts.node_allocator = make_pool_allocator(global_default_allocator, node_pool_chunk_size(config));
+    Allocator *previous_allocator = set_allocator(mcts.node_allocator);
 
-    Mcts_Node *root = mem_alloc<Mcts_Node>();
-    *root = {};
+    // the root has no grid, only the children added by root_add_custom_child
+    Mcts_Node *root = new_mcts_node(0, 0, false);
+    set_allocator(previous_allocator);
 
     root->parent = nullptr;
     
     root->pusher = Grid::grid_as_index(size, start_position);
     
 
-    root->depth = DEPTH_LOWER_CUTOFF+1;
+    root->depth = config.depth_lower_cutoff+1;
     root->flags = MCTS_BLOOMED | MCTS_EXPANDED;
 
     
@@ -978,6 +1332,11 @@ Mcts *new_mcts_bootstrap(u64 seed, Vector2i size, Vector2i start_position) {
     mcts.start_position_tile = start_position;
 
     mcts.root = root;
+    #if TRANSPOSITION_TABLE
+    // the root itself isn't part of the table since it has no board
+    mcts.transpositions = mem_new<Transposition_Table>();
+    *mcts.transpositions = make_transposition_table(global_default_allocator);
+    #endif // TRANSPOSITION_TABLE
 
     auto ptr = mem_alloc<Mcts>();
     *ptr = mcts;
@@ -987,15 +1346,45 @@ void delete_mcts(Mcts* mcts) {
     if(mcts == nullptr) {
         return;
     }
-    mcts->root->destroy();
     for_range(i, 0, mcts->finished_nodes.count) {
         mcts->finished_nodes[i].grid.destroy();
     }
     mcts->finished_nodes.destroy();
-    mem_free(mcts->root);
+    mcts->finished_hashes.destroy();
+    mcts->score_history.destroy();
+    if(mcts->transpositions) {
+        mcts->transpositions->destroy();
+        mem_free(mcts->transpositions);
+    }
+    // frees the whole tree at once
+    mcts->node_allocator->destroy();
+    mem_free(mcts->node_allocator);
+    free_checkpoint_blocks(mcts);
+    mem_free(mcts->resume_random);
     mem_free(mcts);
 }
 
+// Moves the finished levels of src into dst while skipping levels dst already has (see add_finished_level).
+// src keeps its tree but has no finished levels afterwards.
+void merge_finished_levels(Mcts *dst, Mcts *src) {
+    for_range(i, 0, src->finished_nodes.count) {
+        auto &level = src->finished_nodes[i];
+        if(dst->make_room_for_level(grid_symmetry_hash(level.grid), level.score)) {
+            dst->push_finished_level(level);
+        } else {
+            level.grid.destroy();
+        }
+    }
+    src->finished_nodes.count = 0;
+    src->finished_hashes.destroy();
+    #if EXPERIMENTS
+    for_range(i, 0, src->score_history.count) {
+        dst->score_history.add(src->score_history[i]);
+    }
+    src->score_history.count = 0;
+    #endif
+    dst->best_score = max(dst->best_score, src->best_score);
+}
 
 void _get_all_possible_moves(Vector2i tile, Grid &grid, Array<bool> &visited, Array<Move_Info> &moves) {
     for_range(direction, 0, 4) {
@@ -1016,6 +1405,47 @@ void _get_all_possible_moves(Vector2i tile, Grid &grid, Array<bool> &visited, Ar
         }
     }
 }
+/*
+    Same moves as _get_all_possible_moves (in a different order) without recursion and allocations.
+    The cells the pusher can reach are flood filled on a bitboard, one step per iteration for all
+    cells at once. A push in direction d is possible from every reached cell whose neighbour
+    in direction d is a box which is followed by a free cell.
+    moves has to hold MAX_MOVE_COUNT entries. Returns the move count.
+*/
+isize find_all_possible_moves(Vector2i pusher, Grid &grid, const Board_Shape &shape, Move_Info *moves) {
+    assert(shape.width == grid.width && shape.height == grid.height);
+    Bits256 box = grid_cells_with(grid, u8(Pawn::Box));
+    Bits256 free = andnot(shape.inside, grid_cells_with(grid, u8(Pawn::Collision)));
+
+    Bits256 reached = {};
+    reached.set(grid.as_index(pusher.x, pusher.y));
+    assert((reached & free) == reached);
+    while(true) {
+        Bits256 next = (reached | neighbours_of(reached, shape)) & free;
+        if(next == reached) break;
+        reached = next;
+    }
+
+    // same order as DIRECTION_TO_VEC: up, right, down, left
+    Bits256 pushes[4];
+    pushes[0] = reached & shift_down(box & shift_down(free, shape), shape);
+    pushes[1] = reached & shift_left(box & shift_left(free, shape), shape);
+    pushes[2] = reached & shift_up(box & shift_up(free, shape), shape);
+    pushes[3] = reached & shift_right(box & shift_right(free, shape), shape);
+
+    isize move_count = 0;
+    for_range(direction, 0, 4) {
+        for_range(w, 0, 4) {
+            u64 bits = pushes[direction].w[w];
+            while(bits) {
+                assert(move_count < MAX_MOVE_COUNT);
+                moves[move_count++] = Move_Info{u8(w*64 + count_trailing_zeros(bits)), u8(direction)};
+                bits &= bits - 1;
+            }
+        }
+    }
+    return move_count;
+}
 // Iterative variant of the the same function.
 // There seems to be no performance benefit on the highest optimization level
 void _get_all_possible_moves_iterative(Vector2i tile, Grid &grid, Array<bool> &visited, Array<Move_Info> &moves) {
@@ -1050,19 +1480,39 @@ void _get_all_possible_moves_iterative(Vector2i tile, Grid &grid, Array<bool> &v
 
 void debug_check_box_count(Mcts_Node &node, const char *msg) {
     if_debug {
-        auto box_count = get_box_count(node.grid);
+        Grid grid = get_node_grid(node);
+        auto box_count = get_box_count(grid);
         if ( box_count != node.box_count) {
             println(box_count);
             println(node.box_count);
-            println(str(node.grid));
+            println(str(grid));
             println(msg);
             if (node.parent) {
                 println(node.parent->box_count);
             }
             assert(false);
         }
+        grid.destroy();
     }        
 }
+// The incrementally updated hash has to match the full computation
+void debug_check_hash(Mcts_Node &node, const char *msg) {
+    if_debug {
+        u64 hash;
+        if(node.flags & MCTS_SECOND_ACTION) {
+            hash = grid_hash(node.grid);
+        } else {
+            hash = zobrist_hash(node);
+        }
+        if(hash != node.grid.hash) {
+            Grid grid = get_node_grid(node);
+            println(str(grid));
+            println(msg);
+            grid.destroy();
+            assert(false);
+        }
+    }
+}
 void remove_impossible_v1(Mcts_Node *node) {
     auto count = node->grid.get_count();
     for_range(i, 0, count) {
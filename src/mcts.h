@@ -4,6 +4,8 @@
 #include "util.h"
 #include "sokoban.h"
 #include "settings.h"
+#include "bitboard.h"
+#include "config.h"
                                     //  up      right   down    left
 const Vector2i DIRECTION_TO_VEC[4] = {{0, -1}, {1, 0}, {0, 1}, {-1, 0}};
 inline u8 get_direction(const Vector2i &v) {
@@ -24,6 +26,7 @@ enum Mcts_Node_Flag : u8 {
     MCTS_CAN_FREEZE     = 1 << 4,
     MCTS_EVALUATED      = 1 << 5,
     MCTS_FROZEN         = 1 << 6,
+    MCTS_MARKED         = 1 << 7,  // only during prune_tree
 };
 
 #define is_bloomed(NODE)  bool(NODE->flags & MCTS_BLOOMED)
@@ -34,30 +37,90 @@ enum Mcts_Node_Flag : u8 {
 
 struct Mcts_Node;
 struct Mcts;
-// ucb1, ucb1-tuned etc.
-typedef f64(*Decision_Proc)(Mcts_Node *);
-
-void uct_body(Mcts *, const Decision_Proc);
-
-Mcts_Node *tree_policy(Mcts_Node *, Mcts *, const Decision_Proc);
+struct Pool_Allocator;
+struct Transposition_Table;
+struct Tree_Path;
+struct Level_Stream;
+// ucb1, ucb1-tuned etc. of a child (second argument) seen from the parent the rollout came from
+typedef f64(*Decision_Proc)(Mcts_Node *, Mcts_Node *);
+
+// These pick the selection policy of the decision once (see with_decision_policy),
+// the tree policies below them are templates of their file.
+// uct_body and uct_body_transposition return the score of the rollout.
+f64 uct_body(Mcts *, const Decision_Proc);
+void uct_body_parallel(Mcts *, const Decision_Proc);
+f64 uct_body_transposition(Mcts *, const Decision_Proc);
+
+void add_score_and_propagate_path(Mcts_Node *, Tree_Path &, f64);
 f64 default_policy(Mcts_Node *, Mcts *);
-
+// The terminal node of a simulation from the node, nullptr for a dead end.
+// The node belongs to the calling thread and is overwritten by its next call (see mcts_rollout.cpp).
+Mcts_Node *rollout_in_place(Mcts_Node *, Mcts *);
+
+
+// The actions of mcts_actions.h
+enum class Mcts_Action : u8 {
+    Delete_Obstacle,
+    Place_Box,
+    Freeze_Level,
+    Move_Agent,
+    Evaluate_Level,
+};
 
 void bloom(Mcts_Node *, Mcts *);
+// The action of expand_random for a bloomed node with move_count moves left (second phase).
+// Takes the same random numbers as expand_random.
+Mcts_Action pick_random_action(Mcts_Node *, isize move_count);
 Mcts_Node *expand_random(Mcts_Node *, Mcts *);
 Mcts_Node *expand_next(Mcts_Node *, Mcts *);
 
-Mcts_Node *best_child(Mcts_Node *, Mcts *, const Decision_Proc);
+// Defined after the policies (see the end of this file)
+template<typename Policy>
+isize best_child_index(Mcts_Node *, Mcts *, Policy);
+template<typename Policy>
+Mcts_Node *best_child(Mcts_Node *, Mcts *, Policy);
 
 f64 get_score_scale(Mcts *);
+// Sets the config and everything that only depends on it
+void init_mcts_from_config(Mcts &, const Mcts_Config &);
+Mcts *new_mcts(u64, const Mcts_Config &);
+// default_mcts_config with the given size and start position
 Mcts *new_mcts(u64, Vector2i = {5,5}, Vector2i = {-1, -1});
+// The start position of the config has to be a tile
+Mcts *new_mcts_bootstrap(u64, const Mcts_Config &);
 Mcts *new_mcts_bootstrap(u64, Vector2i, Vector2i);
 void root_add_custom_child(Mcts *, Grid &, f64);
 
 void delete_mcts(Mcts *);
-Mcts_Node make_mcts_node(Mcts_Node &);
-Mcts_Node clone_mcts_node(Mcts_Node &, Mcts_Node *);
+// Bytes of the nodes, their arrays and the transposition table
+isize tree_memory_size(Mcts *);
+// What the tree takes from the process: the chunks of the node pool (free blocks included),
+// the blocks of a loaded checkpoint and the transposition table
+isize tree_reserved_size(Mcts *);
+// Of the node pool: POOL_CHUNK_SIZE or less with a small memory budget, so that the pool can stay close to it
+isize node_pool_chunk_size(const Mcts_Config &);
+// Collapses the least visited subtrees until the tree is below 3/4 of Mcts_Config::memory_budget
+// (see mcts_memory.cpp). Not for shared trees.
+void prune_tree(Mcts *);
+void merge_finished_levels(Mcts *, Mcts *);
+// Writes the tree, the finished levels and the random engines of the calling thread to path,
+// returns false if the file can't be written (see mcts_checkpoint.cpp). Not while a search runs on the tree.
+bool save_mcts_checkpoint(Mcts *, const char *path);
+// The search saved by save_mcts_checkpoint, nullptr if the file can't be read or is from another build
+Mcts *load_mcts_checkpoint(const char *path);
+void free_checkpoint_blocks(Mcts *);
+Mcts_Node *new_mcts_node(i32, i32, bool);
+void init_mcts_node(Mcts_Node *, i32, i32, bool);
+Mcts_Node *make_child_node(Mcts_Node &, bool);
+void copy_to_child_node(Mcts_Node &, Mcts_Node *);
+Mcts_Node *clone_mcts_node(Mcts_Node *);
 isize get_box_count(Grid &);
+Grid get_node_grid(Mcts_Node &);
+
+struct Level_Score {
+    f32 score;
+    Chrono_Clock time_stamp;
+};
 
 struct Move_Info {
     u8 index;
@@ -67,12 +130,25 @@ struct Move_Info {
 // See next_rollout/uct_body for the entry point of the algorithm
 struct Mcts {
     Mcts_Node *root;
+    // Every node of the tree and their arrays are allocated from here.
+    // The tree_policy switches to it, the default_policy doesn't use it (see rollout_in_place and the arena).
+    Pool_Allocator *node_allocator;
+    // First phase nodes by their board if TRANSPOSITION_TABLE, else nullptr (see mcts_transposition.cpp)
+    Transposition_Table *transpositions = nullptr;
+    Mcts_Config config;
     u64 seed;
     f64 best_score = -1;
 
+    // The best LEVEL_SET_SIZE levels as a min-heap by score, see add_finished_level
     Array<Level> finished_nodes;
+    // grid_symmetry_hash of every level in finished_nodes
+    Hash_Set finished_hashes;
+    // Score and time of every level that has been added to finished_nodes, filled if EXPERIMENTS
+    Array<Level_Score> score_history;
     
     Vector2i size;
+    // masks for the bitboards of the first phase
+    Board_Shape shape;
     i32 start_position;
     Vector2i start_position_tile;
     f64 area;
@@ -84,14 +160,110 @@ struct Mcts {
     // bool no_delete = false;
     // only used in bootstrapping
     bool finish_early = false;    
+    // doesn't print new levels; used for trees that run on worker threads
+    bool quiet = false;
+    // guards best_score and finished_nodes if the tree is shared between threads (only taken with TREE_PARALLEL)
+    Spin_Lock level_lock;
+    // If set every level that add_finished_level accepts is published to queue stream_queue of it
+    Level_Stream *stream = nullptr;
+    isize stream_queue = 0;
+    // see prune_tree
+    i64 prune_count = 0;
+    i64 pruned_node_count = 0;
+    // Set by load_mcts_checkpoint: the random engines of the saved search, the next start continues with them
+    Random_State *resume_random = nullptr;
+    // The blocks of the loaded checkpoint which are part of the node pool, freed by delete_mcts
+    void *checkpoint_blocks = nullptr;
+    isize checkpoint_size = 0;
     force_inline void next_rollout(const Decision_Proc decision) {
-        uct_body(this, decision);
+        if(transpositions) {
+            uct_body_transposition(this, decision);
+        } else {
+            uct_body(this, decision);
+        }
+        if(config.memory_budget > 0 && f64(tree_memory_size(this)) > config.memory_budget * 1e6) {
+            prune_tree(this);
+        }
     }
     // used for experiments returns info
     f64 experiment_rollout(Mcts *, const Decision_Proc);
 
     Array<Level> get_level_set(isize count = 20);   
-    void start();
+    bool add_finished_level(Grid &, i32, f64, Chrono_Clock = Chrono_Clock());
+    bool make_room_for_level(u64, f64);
+    void push_finished_level(Level &);
+    // ascending by score, which is still a valid heap
+    void sort_finished_levels();
+    // seeds the random engine of the calling thread with seed + thread_index
+    // (the first start of a loaded checkpoint continues with its engines instead)
+    void start(u64 thread_index = 0);
+};
+
+// Random index in range [0, count) used by the actions and expand_random.
+// Inlined since it's called on every expansion.
+inline isize random_index(isize count) {
+    assert(count > 0);
+    #if RANDOM_ENGINE == RANDOM_XOSHIRO
+    return g_xoshiro_engine.bounded(u32(count));
+    #else
+    return randi_range(0, count-1);
+    #endif
+}
+
+// The grid data of a node is padded such that the moves behind it are aligned
+constexpr isize mcts_grid_size(isize cell_count) {
+    return (cell_count + 7) & ~isize(7);
+}
+
+/*
+    The statistics of the children of a node by their index in children,
+    next to each other so that best_child doesn't have to visit the children.
+    In a tree they are copies: the statistics of a node are still the ones in the node and every update
+    also goes to its slot in the parent (child_index, see add_node_stats).
+    In a DAG (transposition table) a slot of a first phase child belongs to the edge instead: it only counts
+    the rollouts which came through this parent, so that they add up to at most the rollouts of the parent
+    like in a tree. These children have no child_index, the backup follows the slots of the Tree_Path.
+    The slots are added by the tree policies (see add_child_stats), the nodes of the default_policy have none.
+*/
+#define CHILD_STATS_SLOT_SIZE (2*sizeof(f64) + sizeof(i32))
+struct Child_Stats {
+    // score_sum[capacity], squared_score_sum[capacity], rollout_count[capacity]
+    f64 *data = nullptr;
+    i32 capacity = 0;
+
+    force_inline f64 *score_sum() {
+        return data;
+    }
+    force_inline f64 *squared_score_sum() {
+        return data + capacity;
+    }
+    force_inline i32 *rollout_count() {
+        return (i32 *)(data + 2*capacity);
+    }
+    force_inline void set(isize index, f64 score, f64 squared, i32 count) {
+        assert(0 <= index && index < capacity);
+        score_sum()[index] = score;
+        squared_score_sum()[index] = squared;
+        rollout_count()[index] = count;
+    }
+    force_inline void add(isize index, f64 score, f64 squared, i32 count) {
+        assert(0 <= index && index < capacity);
+        score_sum()[index] += score;
+        rollout_count()[index] += count;
+
+        #ifdef USE_SQUARED_SUM
+        squared_score_sum()[index] += squared;
+        #endif // USE_SQUARED_SUM
+    }
+    force_inline void add_atomic(isize index, f64 score, f64 squared, i32 count) {
+        assert(0 <= index && index < capacity);
+        atomic_add(&score_sum()[index], score);
+        atomic_add(&rollout_count()[index], count);
+
+        #ifdef USE_SQUARED_SUM
+        atomic_add(&squared_score_sum()[index], squared);
+        #endif // USE_SQUARED_SUM
+    }
 };
 
 struct Mcts_Node {
@@ -105,43 +277,137 @@ struct Mcts_Node {
     Mcts_Node *parent;
     
     Array<Mcts_Node *> children;
+    Child_Stats child_stats;
 
     // See actions for the usage
     // This has been discussed in the paper    
-    Array<u8> first; 
-    Array<u8> second; 
-    Array<Move_Info> moves;
-    // Every node has their own grid
+    // Second phase: every node has their own grid which is stored right behind the node,
+    //               moves and the tables are stored behind the grid (see new_mcts_node)
+    // First phase:  only the size of the grid is set (data is null),
+    //               the board and the sets are bitboards stored behind the node (see block_set)
+    //               grid.hash is still the hash of the board
     Grid grid;
 
     i32 rollout_count = 0;
+    // slot in child_stats of the parent, -1 if none
+    i32 child_index = -1;
     i16 box_count = 0;
     u16 depth = 0;
     u8 flags = 0;
     u8 pusher;    
+    // guards bloom/expansion if the tree is shared between threads
+    Spin_Lock lock;
+    // With a transposition table: the number of nodes which have this first phase node as a child
+    u8 parent_count = 0;
     
     
     
 
+    force_inline u8 *behind_grid() {
+        assert(flags & MCTS_SECOND_ACTION);
+        return (u8 *)grid.data + mcts_grid_size(grid.get_count());
+    }
+    // First phase only: the n-th bitboard behind the node
+    force_inline Cell_Set first_phase_set(isize n) {
+        assert(!(flags & MCTS_SECOND_ACTION));
+        isize word_count = cell_set_word_count(grid.get_count());
+        return {(u64 *)(this + 1) + n*word_count, word_count};
+    }
+    // the cells with a block/box
+    force_inline Cell_Set block_set() {
+        return first_phase_set(0);
+    }
+    force_inline Cell_Set box_set() {
+        return first_phase_set(1);
+    }
+    // the candidates of delete obstacle (first) and place box (second)
+    force_inline Cell_Set first_set() {
+        return first_phase_set(2);
+    }
+    force_inline Cell_Set second_set() {
+        return first_phase_set(3);
+    }
+    // Second phase only
+    force_inline Array<Move_Info> &moves() {
+        assert(flags & MCTS_SECOND_ACTION);
+        return *(Array<Move_Info> *)behind_grid();
+    }
+    // first_table[i]:  start position of the box on cell i
+    // second_table[i]: move count of the box on cell i,
+    //                  after evaluate_level the goal of the box that starts on cell i
+    force_inline u8 *first_table() {
+        assert(flags & MCTS_SECOND_ACTION);
+        return behind_grid() + sizeof(Array<Move_Info>);
+    }
+    force_inline u8 *second_table() {
+        assert(flags & MCTS_SECOND_ACTION);
+        return first_table() + grid.get_count();
+    }
+
+    // the cutoffs of the config are checked by action_freeze
     inline bool can_freeze() {
-        return !(flags&MCTS_FROZEN) && (flags&MCTS_CAN_FREEZE) && (depth>=DEPTH_LOWER_CUTOFF);
+        return !(flags&MCTS_FROZEN) && (flags&MCTS_CAN_FREEZE);
     }
     inline bool can_expand() {
         assert( !(flags & MCTS_TERMINAL) && (flags & MCTS_BLOOMED));
         
         if(flags & MCTS_SECOND_ACTION) {
-            return (moves.count>0) || !(flags & MCTS_EVALUATED);
+            return (moves().count>0) || !(flags & MCTS_EVALUATED);
         }
-        bool b1 = first.count > 0;
-        bool b2 = second.count > 0;
+        bool b1 = !first_set().is_empty();
+        bool b2 = !second_set().is_empty();
         bool b3 = can_freeze();
         return b1 || b2 || b3;
     }
     void add_score_and_propagate(f64 score);
+    void add_score_and_propagate_parallel(f64 score);
 
     void destroy();
 };
 
+// Size of a node together with the data that is stored behind it (see new_mcts_node)
+constexpr isize mcts_node_size(isize cell_count, bool second_action) {
+    isize data_size = 0;
+    if(second_action) {
+        data_size = mcts_grid_size(cell_count) + sizeof(Array<Move_Info>) + 2 * cell_count;
+    } else {
+        data_size = 4 * cell_set_word_count(cell_count) * sizeof(u64);
+    }
+    return sizeof(Mcts_Node) + data_size;
+}
+
+// The last child of node has just been added by the tree policy: gives it a slot in the child_stats of node.
+// With TREE_PARALLEL it has to be called under the lock of node.
+// edge: a first phase child of a DAG, the slot starts empty and only counts this edge (see Child_Stats).
+void add_child_stats(Mcts_Node *, bool edge = false);
+
+// Adds to the statistics of the node and its slots (see Child_Stats)
+inline void add_node_stats(Mcts_Node *node, f64 score, f64 squared, i32 count) {
+    node->score_sum += score;
+    node->rollout_count += count;
+
+    #ifdef USE_SQUARED_SUM
+    node->squared_score_sum += squared;
+    #endif // USE_SQUARED_SUM
+
+    if(node->child_index >= 0) {
+        node->parent->child_stats.add(node->child_index, score, squared, count);
+    }
+}
+// add_node_stats of a shared tree (see mcts_parallel.cpp)
+inline void add_node_stats_atomic(Mcts_Node *node, f64 score, f64 squared, i32 count) {
+    atomic_add(&node->score_sum, score);
+    atomic_add(&node->rollout_count, count);
+
+    #ifdef USE_SQUARED_SUM
+    atomic_add(&node->squared_score_sum, squared);
+    #endif // USE_SQUARED_SUM
+
+    if(node->child_index >= 0) {
+        node->parent->child_stats.add_atomic(node->child_index, score, squared, count);
+    }
+}
+
 void rollout(Mcts_Node*);
 
 void remove_impossible_v1(Mcts_Node *);
@@ -149,6 +415,8 @@ void remove_impossible_v2(Mcts_Node *);
 
 
 f64 score_node(Mcts_Node &, Mcts *);
+i32 area_score_of_v2(Grid &);
+i32 area_score_of_v2_simd(Grid &);
 f64 score_node_test(Mcts_Node &, Mcts *, f64, f64, f64, f64, f64, f64, f64);
 
 template<typename T>
@@ -166,9 +434,8 @@ inline void node_data_remove(Static_Array<T, 4> &data, isize index) {
     data.count -= 1;
 } */
 
-inline Mcts_Node *new_node_child(Mcts_Node &parent, Mcts *tree) {
-    Mcts_Node *child = mem_alloc<Mcts_Node>();
-    *child = make_mcts_node(parent);
+inline Mcts_Node *new_node_child(Mcts_Node &parent, Mcts *, bool second_action = false) {
+    Mcts_Node *child = make_child_node(parent, second_action || (parent.flags & MCTS_SECOND_ACTION));
     parent.children.add(child);
     return child;
 }
@@ -184,8 +451,115 @@ void print_scored_nodes(Mcts &);
 
 
 void debug_check_box_count(Mcts_Node &node, const char *msg = nullptr);
+void debug_check_hash(Mcts_Node &node, const char *msg = nullptr);
 #include "uct_enhancements.h"
 
+// The index of the child with the highest value of the selection policy, the first one if there are several.
+// Policies with eval get the statistics of up to BEST_CHILD_BLOCK children at once from the child_stats
+// of the node (from the children if it has none), the others go through the children
+// (in a DAG they see the rollouts of a shared child through all its parents then).
+#define BEST_CHILD_BLOCK 64
+template<typename Policy>
+isize best_child_index(Mcts_Node *node, Mcts *, Policy decision) {
+    f64 max_val = F64_MIN;
+    isize arg = -1;
+    assert(node->children.count > 0);
+    if constexpr(Policy::batched) {
+        auto &stats = node->child_stats;
+        assert(!stats.data || stats.capacity >= node->children.count);
+        #if !TREE_PARALLEL
+        if_debug {
+            if(stats.data) {
+                for_range(i, 0, node->children.count) {
+                    Mcts_Node *it = node->children[i];
+                    // the edge slots of a DAG have their own statistics
+                    if(it->child_index != i) continue;
+                    assert(stats.score_sum()[i] == it->score_sum && stats.rollout_count()[i] == it->rollout_count);
+                    assert(stats.squared_score_sum()[i] == it->squared_score_sum);
+                }
+            }
+        }
+        #endif // !TREE_PARALLEL
+        decision.set_parent(node);
+        f64 values[BEST_CHILD_BLOCK];
+        for(isize start = 0; start < node->children.count; start += BEST_CHILD_BLOCK) {
+            isize n = min<isize>(BEST_CHILD_BLOCK, node->children.count - start);
+            const f64 *score, *squared;
+            const i32 *count;
+            f64 score_copy[BEST_CHILD_BLOCK], squared_copy[BEST_CHILD_BLOCK];
+            i32 count_copy[BEST_CHILD_BLOCK];
+            if(!stats.data) {
+                for_range(i, 0, n) {
+                    Mcts_Node *it = node->children[start + i];
+                    score_copy[i] = atomic_load(&it->score_sum);
+                    squared_copy[i] = atomic_load(&it->squared_score_sum);
+                    count_copy[i] = atomic_load(&it->rollout_count);
+                }
+                score = score_copy;
+                squared = squared_copy;
+                count = count_copy;
+            } else if(TREE_PARALLEL) {
+                // the slots are updated with atomics
+                for_range(i, 0, n) {
+                    score_copy[i] = atomic_load(&stats.score_sum()[start + i]);
+                    squared_copy[i] = atomic_load(&stats.squared_score_sum()[start + i]);
+                    count_copy[i] = atomic_load(&stats.rollout_count()[start + i]);
+                }
+                score = score_copy;
+                squared = squared_copy;
+                count = count_copy;
+            } else {
+                score = stats.score_sum() + start;
+                squared = stats.squared_score_sum() + start;
+                count = stats.rollout_count() + start;
+            }
+            isize i = 0;
+            #ifdef F64X_LANES
+            for(; i + F64X_LANES <= n; i += F64X_LANES) {
+                decision.eval(F64x::load(score + i), F64x::load(squared + i), F64x::load(count + i)).store(values + i);
+            }
+            #endif // F64X_LANES
+            for(; i < n; i += 1) {
+                values[i] = decision.eval(score[i], squared[i], f64(count[i]));
+            }
+            for_range(j, 0, n) {
+                if(values[j] > max_val) {
+                    max_val = values[j];
+                    arg = start + j;
+                }
+            }
+        }
+    } else {
+        for_range(i, 0, node->children.count) {
+            Mcts_Node *it = node->children[i];
+            f64 val = decision(node, it);
+            if(val > max_val) {                
+                max_val = val;
+                arg = i;
+            }        
+        }
+    }
+    if_debug {
+        if(arg<0) {
+            Grid grid = get_node_grid(*node);
+            println(str(grid));
+            grid.destroy();
+            for_range(i, 0, node->children.count) {
+                Mcts_Node *it = node->children[i];
+                println(it->score_sum, it->squared_score_sum, node->rollout_count, it->rollout_count);
+                f64 val = decision(node, it);
+                println(val);
+            }            
+        }
+    }
+    assert(arg >= 0);
+    return arg;
+}
+template<typename Policy>
+Mcts_Node *best_child(Mcts_Node *node, Mcts *tree, Policy decision) {
+    return node->children[best_child_index(node, tree, decision)];
+}
+
 #endif // MCTS_H
 
 
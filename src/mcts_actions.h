@@ -2,6 +2,7 @@
 #define MCTS_ACTIONS_H
 
 #include "mcts.h"
+#include "transposition.h"
 /*
     Following we have the implementations of the 5 actions.
     The have been implemented as follows:
@@ -10,6 +11,8 @@
 
         The action is then being applied for the expansion with
         new_* which returns a new child node with action * being applied.
+        The changes to the child itself are done by apply_*, the rollout
+        applies them to its scratch nodes instead (see mcts_rollout.cpp).
 
 */
 
@@ -21,104 +24,91 @@ inline void action_delete_obstacle(Mcts_Node &node, Mcts *tree) {
     /* if(tree->no_delete) {
         return;
     } */
-    assert((node.first.count == 0));
-    Vector2i tile;
-    for_grid(tile, node.grid) {            
-        if(!pawn_is_block(node.grid.get(tile))) continue;
-        for_range(direction, 0, 4) {
-            Vector2i v = tile + DIRECTION_TO_VEC[direction];
-            if(node.grid.in_grid(v.x, v.y) && !pawn_is_block(node.grid.get(v))) {
-                node.first.add(node.grid.as_index(tile));
-                break;
-            }
-        }        
-    }    
+    auto first = node.first_set();
+    assert(first.is_empty());
+    // every block with at least one neighbour which isn't a block
+    Bits256 block = load_bits(node.block_set());
+    Bits256 open = andnot(tree->shape.inside, block);
+    store_bits(first, block & neighbours_of(open, tree->shape));
 }
 
 inline void alternative_action_delete_obstacle(Mcts_Node &node, Mcts *tree) {
     /* if(tree->no_delete) {
         return;
     } */
-    assert((node.first.count == 0));
-    // two empty tiles can 'mark' the same block so we have to save
-    // all the used blocks
-    auto is_used = make_array<bool>(node.grid.get_count());
-    init_data(is_used, false);
-
-    Vector2i tile;
-    for_grid(tile, node.grid) {            
-            if(pawn_is_block(node.grid.get(tile))) continue;
-            for_range(direction, 0, 4) {
-                Vector2i v = tile + DIRECTION_TO_VEC[direction];
-                i32 idx = node.grid.as_index(v.x, v.y);
-                if(node.grid.in_grid(v.x, v.y) && !is_used[idx] && pawn_is_block(node.grid.get(idx))) {
-                    assert(idx<=255);
-                    node.first.add(idx);
-                    is_used[idx] = true;
-                }
-            }
-    }
-    is_used.destroy();
-    
+    auto first = node.first_set();
+    assert(first.is_empty());
+    // two empty tiles can 'mark' the same block which the set takes care of
+    Bits256 block = load_bits(node.block_set());
+    Bits256 open = andnot(tree->shape.inside, block);
+    Bits256 marked = {};
+    marked = marked | (block & shift_up(open, tree->shape));
+    marked = marked | (block & shift_right(open, tree->shape));
+    marked = marked | (block & shift_down(open, tree->shape));
+    marked = marked | (block & shift_left(open, tree->shape));
+    store_bits(first, marked);
 }
 
-inline Mcts_Node *new_delete_obstacle(Mcts_Node &node, Mcts *tree) {
-
-    assert(node.first.count > 0);
-
-    auto child = new_node_child(node, tree);
-    
-    auto rand_idx = randi_range(0, node.first.count-1);
-    auto idx = node.first[rand_idx];
-    assert(node.grid.get(idx) == Pawn::Block);
-    child->grid.set(idx, Pawn::Empty);
+// Picks one of the first_set of node, child has the board of node
+inline void apply_delete_obstacle(Mcts_Node &node, Mcts_Node &child) {
+    auto first = node.first_set();
+    auto idx = first.nth(random_index(first.count()));
+    assert(node.block_set().has(idx));
+    child.block_set().remove(idx);
+    child.grid.hash ^= ZOBRIST_KEYS.block[idx];
 
     // 'hide' the value such that it can't be picked again
-    node_data_remove(node.first, rand_idx);
-
+    first.remove(idx);
+    if_debug {
+        debug_check_hash(child, "delete obstacle");
+    }
+}
+inline Mcts_Node *new_delete_obstacle(Mcts_Node &node, Mcts *tree) {
+    assert(!node.first_set().is_empty());
+    auto child = new_node_child(node, tree);
+    apply_delete_obstacle(node, *child);
     return child;
 }
 // place a block into an empty tile
 inline void action_place_box(Mcts_Node &node, Mcts *tree) {    
     if(node.box_count >= tree->box_upper_cutoff) return;//|| node.box_count >= node.depth/2) return;
-    assert((node.second.count == 0));
-
-    for_range(i, 0, node.grid.get_count()) {
-        Pawn it = node.grid.data[i];
-        if(pawn_is_empty(it) && i != tree->start_position) {
-            assert(i<=255);
-            node.second.add(i);
-        }
-    }
+    auto second = node.second_set();
+    assert(second.is_empty());
+
+    // empty cells besides the start position
+    Bits256 empty = andnot(tree->shape.inside, load_bits(node.block_set()));
+    empty = andnot(empty, load_bits(node.box_set()));
+    empty.reset(tree->start_position);
+    store_bits(second, empty);
 } 
 
+// Picks one of the second_set of node, child has the board of node
+inline void apply_place_box(Mcts_Node &node, Mcts_Node &child) {
+    auto second = node.second_set();
+    auto idx = second.nth(random_index(second.count()));
+    assert(!node.block_set().has(idx) && !node.box_set().has(idx));
+    child.box_set().add(idx);
+    child.grid.hash ^= ZOBRIST_KEYS.box[idx];
+    child.box_count += 1;
+    second.remove(idx);
+    if_debug {
+        debug_check_hash(child, "place box");
+    }
+}
 inline Mcts_Node *new_place_box(Mcts_Node &node, Mcts *tree) {
-
-    assert(node.second.count > 0);
-        
+    assert(!node.second_set().is_empty());
     auto child = new_node_child(node, tree);
-    
-    auto rand_idx = randi_range(0, node.second.count-1);
-    auto idx = node.second[rand_idx];
-    assert(node.grid.get(idx) == Pawn::Empty);
-    child->grid.set(idx, Pawn::Box);
-    child->box_count += 1;
-    node_data_remove(node.second, rand_idx);
-
+    apply_place_box(node, *child);
     return child;
 }
-inline void action_freeze(Mcts_Node &node) {
-    if(node.box_count >= BOX_LOWER_CUTOFF) {
+inline void action_freeze(Mcts_Node &node, Mcts *tree) {
+    if(node.box_count >= tree->config.box_lower_cutoff && node.depth >= tree->config.depth_lower_cutoff) {
         node.flags |= MCTS_CAN_FREEZE;
     }
 }
-inline Mcts_Node *new_freeze_level(Mcts_Node &node, Mcts *tree) {
-    
-
-    node.flags |= MCTS_FROZEN;        
-
-    auto child = new_node_child(node, tree);
-    child->flags |= MCTS_SECOND_ACTION;
+// child is the first second phase node, its grid comes from the bitboards of node (see make_child_node)
+inline void apply_freeze_level(Mcts_Node &node, Mcts_Node *child, Mcts *tree) {
+    assert(child->flags & MCTS_SECOND_ACTION);
     
     if(pawn_is_box(child->grid.get(tree->start_position))) {
         // we override it
@@ -133,14 +123,14 @@ inline Mcts_Node *new_freeze_level(Mcts_Node &node, Mcts *tree) {
         assert(pawn_is_empty(child->grid.get(tree->start_position)));
     }
 
-    // saves the start position of the boxes
-    child->first.resize(child->grid.get_count()); 
-    // saves the move count of the boxes
-    child->second.resize(child->grid.get_count()); 
+    // first_table saves the start position of the boxes
+    // second_table saves the move count of the boxes
+    u8 *first = child->first_table();
+    u8 *second = child->second_table();
 
     // ----------------
 
-    if constexpr (REMOVE_IMPOSSIBLE) {
+    if(tree->config.remove_impossible) {
         // v1 doesn't perform well, while v2 does
         remove_impossible_v2(child);
     }
@@ -148,100 +138,137 @@ inline Mcts_Node *new_freeze_level(Mcts_Node &node, Mcts *tree) {
     // ---------------
     for_range(i, 0, child->grid.get_count()) {
         if(pawn_is_box(child->grid.get(i))) {
-            child->first[i] = i; // box start position
-            child->second[i] = 0; // move counter
+            first[i] = i; // box start position
+            second[i] = 0; // move counter
         } else {
-            child->first[i]  = INVALID_INDEX;
-            child->second[i] = INVALID_INDEX;
+            first[i]  = INVALID_INDEX;
+            second[i] = INVALID_INDEX;
         }
     }
     if_debug {
         debug_check_box_count(node, "freeze parent");        
         debug_check_box_count(*child, "freeze child");        
+        debug_check_hash(*child, "freeze child");
     }
+}
+inline Mcts_Node *new_freeze_level(Mcts_Node &node, Mcts *tree) {
+    node.flags |= MCTS_FROZEN;        
+    auto child = new_node_child(node, tree, true);
+    apply_freeze_level(node, child, tree);
     return child;
 }
 
 void _get_all_possible_moves(Vector2i tile, Grid &grid, Array<bool> &visited, Array<Move_Info> &);
 void _get_all_possible_moves_iterative(Vector2i tile, Grid &grid, Array<bool> &visited, Array<Move_Info> &);
+isize find_all_possible_moves(Vector2i, Grid &, const Board_Shape &, Move_Info *);
 
-inline Array<Move_Info> get_all_possible_moves(Vector2i pusher, Grid &grid) {
-    Array<bool> visited = make_array<bool>(grid.get_count());
+// Every push is a distinct pair of reachable cell and direction
+#define MAX_MOVE_COUNT (4*MAX_CELL_COUNT)
 
-    init_data(visited, false);
-    visited[grid.as_index(pusher.x, pusher.y)] = true;
-    auto moves = make_array<Move_Info>(0, 5);
-    _get_all_possible_moves(pusher, grid, visited, moves);
-    visited.destroy();
-    return moves;
+// moves is a scratch buffer of the caller which is cleared and reused, it only allocates
+// if it has less than MAX_MOVE_COUNT entries.
+inline void get_all_possible_moves(Vector2i pusher, Grid &grid, const Board_Shape &shape, Array<Move_Info> &moves) {
+    if(moves.capacity < MAX_MOVE_COUNT) {
+        moves.destroy();
+        moves = make_array<Move_Info>(0, MAX_MOVE_COUNT);
+    }
+    moves.count = find_all_possible_moves(pusher, grid, shape, moves.data);
+    if_debug {
+        // the recursive version has to find the same moves
+        Array<bool> visited = make_array<bool>(grid.get_count());
+        init_data(visited, false);
+        visited[grid.as_index(pusher.x, pusher.y)] = true;
+        auto expected = make_array<Move_Info>(0, 5);
+        _get_all_possible_moves(pusher, grid, visited, expected);
+        assert(expected.count == moves.count);
+        for_range(i, 0, expected.count) {
+            bool found = false;
+            for_range(j, 0, moves.count) {
+                found = found || (expected[i].index == moves[j].index && expected[i].direction == moves[j].direction);
+            }
+            assert(found);
+        }
+        expected.destroy();
+        visited.destroy();
+    }
 }
 
-inline Array<Move_Info> generate_all_possible_moves(Mcts_Node &node) {
+// The moves of node into the scratch buffer moves (see get_all_possible_moves)
+inline void generate_all_possible_moves(Mcts_Node &node, Mcts *tree, Array<Move_Info> &moves) {
     if(node.box_count == 0) {
-        return {};
+        moves.count = 0;
+        return;
     }
     assert(pawn_is_empty(node.grid.get(node.pusher)));
-    auto moves = get_all_possible_moves(node.grid.as_tile(node.pusher), node.grid);
+    get_all_possible_moves(node.grid.as_tile(node.pusher), node.grid, tree->shape, moves);
     if constexpr (false) {
         println(str(node.grid));
         for_range(i, 0, moves.count) {
             println(node.grid.as_tile(moves[i].index), "  ", DIRECTION_TO_VEC[moves[i].direction]);
         }
     }
-    return moves;
 }
 
 // this is the simple variant of the function which only moves one tile
 // at the time
 // used for comparison in the experiments
-inline Array<Move_Info> simple_move_agent(Mcts_Node &node, Mcts *tree) {
+inline void simple_move_agent(Mcts_Node &node, Mcts *, Array<Move_Info> &moves) {
+    moves.count = 0;
     if(node.box_count == 0) {
-        return {};
+        return;
     }
     auto pos = node.grid.as_tile(node.pusher);
     u8 pos_i = node.pusher;
-    auto moves = make_array<Move_Info>(0, 5);
     for_range(direction, 0, 4) {
         Vector2i v = DIRECTION_TO_VEC[direction];        
         if(node.grid._could_move(pos.x, pos.y, v)) {
             moves.add(Move_Info{pos_i, (u8)direction});
         }
     }
-    return moves;
 }
 
-inline void action_move_agent(Mcts_Node &node, Mcts *tree) {
-    assert(node.moves.count == 0);
+// The moves of action_move_agent in the same order, but into buffer (MAX_MOVE_COUNT) instead of an array
+inline isize find_agent_moves(Mcts_Node &node, Mcts *tree, Move_Info *buffer) {
+    if(node.box_count == 0) {
+        return 0;
+    }
+    if(!tree->config.simple_moves) {
+        assert(pawn_is_empty(node.grid.get(node.pusher)));
+        return find_all_possible_moves(node.grid.as_tile(node.pusher), node.grid, tree->shape, buffer);
+    }
+    auto pos = node.grid.as_tile(node.pusher);
+    isize count = 0;
+    for_range(direction, 0, 4) {
+        if(node.grid._could_move(pos.x, pos.y, DIRECTION_TO_VEC[direction])) {
+            buffer[count++] = Move_Info{node.pusher, (u8)direction};
+        }
+    }
+    return count;
+}
+
+// The moves are found in scratch (see get_all_possible_moves), node gets a copy with their exact count.
+inline void action_move_agent(Mcts_Node &node, Mcts *tree, Array<Move_Info> &scratch) {
+    assert(node.moves().count == 0);
     assert((node.flags & MCTS_SECOND_ACTION));
-    if constexpr (!USE_SIMPLE_MOVES) {
-        node.moves = generate_all_possible_moves(node);
+    if(!tree->config.simple_moves) {
+        generate_all_possible_moves(node, tree, scratch);
     } else {
-        node.moves = simple_move_agent(node, tree);
+        simple_move_agent(node, tree, scratch);
+    }
+    if(scratch.count > 0) {
+        node.moves() = make_array<Move_Info>(scratch.count);
+        memcpy(node.moves().data, scratch.data, scratch.count * sizeof(Move_Info));
     }
 }
 
 
 
 
-inline Mcts_Node *new_move_agent(Mcts_Node &_node, Mcts *tree) {
-    if_debug {
-        debug_check_box_count(_node, "move start");
-        assert(pawn_is_empty(_node.grid.get(_node.pusher)));
-    }
-
-
-    assert(_node.moves.count>0);
-    
-    
-    auto child = new_node_child(_node, tree);
-
-    auto rand_idx = randi_range(0, _node.moves.count-1);
-    auto pusher_idx = _node.moves[rand_idx].index;
-    assert(_node.moves[rand_idx].direction<4);
-    Vector2i d = DIRECTION_TO_VEC[_node.moves[rand_idx].direction];
-    //child->pusher = pusher_idx;
-    
-    
+// The move is one of the moves of the parent of child, child has the grid of the parent
+inline void apply_move_agent(Mcts_Node *child, Move_Info move, [[maybe_unused]] Mcts *tree) {
+    auto pusher_idx = move.index;
+    assert(move.direction<4);
+    Vector2i d = DIRECTION_TO_VEC[move.direction];
     Vector2i pusher = child->grid.as_tile(pusher_idx);
     auto move_to = child->grid.as_index(pusher + d);
 
@@ -265,87 +292,103 @@ inline Mcts_Node *new_move_agent(Mcts_Node &_node, Mcts *tree) {
         assert(pawn_is_box(child->grid.get(push_pos)));
         if_debug {
             if(pawn_has_collision(child->grid.get(move_to))) {
-                println_str(_node.grid);
                 println_str(child->grid);
                 println(pusher, d);
-                print_move_infos(_node.moves, _node.grid);
                 assert(false);
             }           
         }
 
-        assert(child->first[push_pos] == INVALID_INDEX);
-        assert(child->first[move_to]  != INVALID_INDEX);
-        assert(child->second[push_pos] == INVALID_INDEX);
-        assert(child->second[move_to]  != INVALID_INDEX);
+        u8 *first = child->first_table();
+        u8 *second = child->second_table();
+        assert(first[push_pos] == INVALID_INDEX);
+        assert(first[move_to]  != INVALID_INDEX);
+        assert(second[push_pos] == INVALID_INDEX);
+        assert(second[move_to]  != INVALID_INDEX);
          
-        child->first[push_pos] = child->first[move_to];
+        first[push_pos] = first[move_to];
         // increase move_count for the specific box
-        child->second[push_pos] = child->second[move_to] + 1;
+        second[push_pos] = second[move_to] + 1;
 
-        child->first[move_to] =  INVALID_INDEX;
-        child->second[move_to] = INVALID_INDEX;
+        first[move_to] =  INVALID_INDEX;
+        second[move_to] = INVALID_INDEX;
         
     } else {
         // we can just move
         child->grid.swap_top_layer(pusher_idx, move_to);
         // this part should get never hit with optimized move_agent
-        assert(USE_SIMPLE_MOVES);
+        assert(tree->config.simple_moves);
     }
     child->pusher = move_to;
-    node_data_remove(_node.moves, rand_idx);
+}
+
+inline Mcts_Node *new_move_agent(Mcts_Node &_node, Mcts *tree) {
     if_debug {
-        debug_check_box_count(*child, "move end");
+        debug_check_box_count(_node, "move start");
+        assert(pawn_is_empty(_node.grid.get(_node.pusher)));
     }
-    return child;
-}
 
-inline Mcts_Node *new_evaluate_level(Mcts_Node &_node, Mcts *tree) {
 
-    _node.flags |= MCTS_EVALUATED; 
+    assert(_node.moves().count>0);
+    
+    
     auto child = new_node_child(_node, tree);
 
+    auto rand_idx = random_index(_node.moves().count);
+    apply_move_agent(child, _node.moves()[rand_idx], tree);
+    node_data_remove(_node.moves(), rand_idx);
+    if_debug {
+        debug_check_box_count(*child, "move end");
+        debug_check_hash(*child, "move end");
+    }
+    return child;
+}
+
+// child has the grid and the tables of the parent
+inline void apply_evaluate_level(Mcts_Node *child, Mcts *tree) {
     child->flags |= MCTS_TERMINAL;
+    u8 *first = child->first_table();
+    u8 *second = child->second_table();
 
     for_range(i, 0, child->grid.get_count()) {
         if(pawn_is_box(child->grid.data[i])) {
-            i32 move_count = child->second[i];
+            i32 move_count = second[i];
             assert(move_count>=0);
 
             // replace with Block
             if(move_count == 0) {
-                assert(child->first[i] == i);
-                child->grid.data[i] = Pawn::Block;
+                assert(first[i] == i);
+                child->grid.set(i, Pawn::Block);
                 child->box_count -= 1;
 
-                child->first[i] = INVALID_INDEX;
-                child->second[i] = INVALID_INDEX;
+                first[i] = INVALID_INDEX;
+                second[i] = INVALID_INDEX;
                 continue;
             }
             
             // replace with Empty
             if(move_count == 1) {
                 // DOS(A) bool(!grid.in_grid(A.x, A.y) || pawn_is_block(grid.get(A.x, A.y)))
-                child->grid.data[i] = Pawn::Empty;
+                child->grid.set(i, Pawn::Empty);
                 child->box_count -= 1;
 
-                child->first[i] = INVALID_INDEX;
-                child->second[i] = INVALID_INDEX;                
+                first[i] = INVALID_INDEX;
+                second[i] = INVALID_INDEX;                
 
                 continue;
             }
             continue;
             // other experiments with the post processing            
             auto from = child->grid.as_tile(i);
-            auto to = child->grid.as_tile(child->first[i]);
+            auto to = child->grid.as_tile(first[i]);
             auto d = to - from;
             d = {abs(d.x), abs(d.y)};
             auto m = d.x + d.y;
             if(m <= 1) {
-                child->grid.data[i] = Pawn::Empty;
+                child->grid.set(i, Pawn::Empty);
                 child->box_count -= 1;
 
-                child->first[i] = INVALID_INDEX;
-                child->second[i] = INVALID_INDEX;                
+                first[i] = INVALID_INDEX;
+                second[i] = INVALID_INDEX;                
                 continue;
             }
         }
@@ -353,13 +396,13 @@ inline Mcts_Node *new_evaluate_level(Mcts_Node &_node, Mcts *tree) {
     // replace current box positions with goals
     for_range(i, 0, child->grid.get_count()) {
             if(pawn_is_box(child->grid.data[i])) {
-                // assert(child->second[i] >= 0);
-                child->grid.data[i] = Pawn::Goal;
+                // assert(second[i] >= 0);
+                child->grid.set(i, Pawn::Goal);
 
                 // this is the start position of the goal                
-                auto start = child->first[i];
+                auto start = first[i];
                 // we save in second, at the start position, the goal position
-                child->second[start] = i;
+                second[start] = i;
             }
     }
 
@@ -372,7 +415,7 @@ inline Mcts_Node *new_evaluate_level(Mcts_Node &_node, Mcts *tree) {
 
     // place the boxes at their start position
     for_range(i, 0, child->grid.get_count()) {
-        auto start = child->first[i];
+        auto start = first[i];
         if(start != INVALID_INDEX) {
             u8 bot = bot_layer(child->grid.data[start]);
             child->grid.set(start, Pawn(u8(Pawn::Box) | bot));
@@ -399,7 +442,13 @@ inline Mcts_Node *new_evaluate_level(Mcts_Node &_node, Mcts *tree) {
             assert(false);
         }
         assert(g_count == b_count && g_count == child->box_count);
+        debug_check_hash(*child, "evaluate");
     }
+}
+inline Mcts_Node *new_evaluate_level(Mcts_Node &_node, Mcts *tree) {
+    _node.flags |= MCTS_EVALUATED; 
+    auto child = new_node_child(_node, tree);
+    apply_evaluate_level(child, tree);
     return child;
 }
 
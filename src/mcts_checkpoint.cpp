@@ -0,0 +1,587 @@
+#include "mcts.h"
+#include "settings.h"
+#include "allocator.h"
+#include "transposition.h"
+#include <type_traits>
+#include <sstream>
+#include <filesystem>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+/*
+    Checkpoints (save_mcts_checkpoint, load_mcts_checkpoint): the tree, the finished levels and the
+    random engines of a search, so that a search which has been stopped can go on where it was saved.
+    The command line has them as --checkpoint path and --resume path (see main.cpp and generate.h).
+
+    File: Checkpoint_Header, the finished levels (Checkpoint_Level followed by the cells) and at
+    block_offset (a multiple of CHECKPOINT_ALIGNMENT) the blocks of the tree.
+    - Every block of the node pool (node, children, child_stats, moves) is stored the way it is in the pool:
+      a Checkpoint_Block, the Pool_Block_Header and the data padded to the capacity of its size class.
+      Pointers inside of the blocks are offsets of the data from the start of the blocks, 0 is nullptr.
+    - The tree is written in a single pass in post-order: the children of a node are written before it,
+      so their offsets are known when the node is written. A shared child (transposition table) is written
+      once, Offset_Table remembers the offsets of the written nodes.
+    - The loader maps the blocks (copy on write, the file doesn't change) and turns the offsets back
+      into pointers with one pass over the blocks, a second pass sets the parents from the children.
+      The blocks become blocks of the node pool (see Pool_Allocator::adopt): the search can free and
+      reuse them like every other block. The mapping stays until delete_mcts.
+    - Parents aren't stored. A shared child gets one of its parents, not necessarily the one
+      it has been created from (only the second phase uses the parent of a first phase node).
+    - The transposition table is built again from the first phase nodes.
+    - score_history (EXPERIMENTS) and the level stream aren't part of a checkpoint.
+    - The pool of the loaded tree has no free blocks. A memory budget still prunes after the same
+      rollouts as in the saved search: it compares the size in use, which doesn't depend on them (see prune_tree).
+
+    A checkpoint only fits the build it has been written by: the header has the version, the node size
+    and the settings which change the tree (see checkpoint_settings).
+    The random engines are the ones of the calling thread, the search has to be saved from the thread it ran on.
+    That rules out the parallel runs: the trees of run_mcts_timeout_root_parallel run on worker threads
+    which are gone at the end, a tree parallel search has the engines of several threads.
+    Their states are stored as numbers (std::mt19937 as the text of operator<<, the layout of the
+    standard library type is not the same everywhere). The loader rejects a checkpoint of another RANDOM_ENGINE.
+*/
+
+#define CHECKPOINT_MAGIC 0x54504b43534f4b53ull // "SKOSCKPT"
+#define CHECKPOINT_VERSION 3
+// of the file offset of the blocks, a multiple of the page size for mmap
+#define CHECKPOINT_ALIGNMENT (1 << 16)
+// of the text of std::mt19937 (624 + 1 numbers of up to 10 digits and the spaces)
+#define CHECKPOINT_MERSENNE_SIZE 7168
+
+struct Checkpoint_Header {
+    u64 magic;
+    u32 version;
+    u32 node_size;      // sizeof(Mcts_Node)
+    u32 settings;       // checkpoint_settings
+    u32 level_count;
+    Mcts_Config config;
+    u64 seed;
+    f64 best_score;
+    f64 elapsed;        // seconds since time_start
+    i64 prune_count;
+    i64 pruned_node_count;
+    Vector2i start_position_tile;
+    i32 start_position;
+    u32 last_rollout_depth;
+    i64 block_offset;   // in the file
+    i64 block_size;     // bytes of all blocks
+    i64 node_count;
+    u64 root;           // offset of the root
+    u32 random_engine;  // RANDOM_ENGINE
+    u32 rand_state;     // see Random_State
+    u64 xoshiro[4];
+    char mersenne[CHECKPOINT_MERSENNE_SIZE]; // operator<< of std::mt19937, zero terminated
+};
+static_assert(std::is_trivially_copyable<Checkpoint_Header>::value, "the header is written as it is");
+
+struct Checkpoint_Level {
+    i32 width;
+    i32 height;
+    i32 box_count;
+    f32 score;
+    f64 time;           // seconds since time_start
+    u64 hash;
+};
+
+enum class Checkpoint_Block_Kind : u32 {
+    Node,
+    Children,   // offsets of the children
+    Data,       // child_stats and moves, no pointers
+};
+// In front of every block
+struct Checkpoint_Block {
+    Checkpoint_Block_Kind kind;
+    u32 count;          // the bytes the block has been allocated with (see Pool_Allocator::adopt)
+};
+
+static u32 checkpoint_settings() {
+    u32 settings = MAX_CELL_COUNT << 8;
+    if(TRANSPOSITION_TABLE) settings |= 1;
+    #ifdef USE_SQUARED_SUM
+    settings |= 2;
+    #endif // USE_SQUARED_SUM
+    return settings;
+}
+
+static void write_random_state(Checkpoint_Header &header, const Random_State &state) {
+    header.random_engine = RANDOM_ENGINE;
+    header.rand_state = state.rand_state;
+    for_range(i, 0, 4) {
+        header.xoshiro[i] = state.xoshiro.state[i];
+    }
+    std::ostringstream text;
+    text << state.mersenne;
+    auto string = text.str();
+    release_assert(string.size() < sizeof(header.mersenne), "mersenne state doesn't fit into the checkpoint");
+    memcpy(header.mersenne, string.c_str(), string.size() + 1);
+}
+static bool read_random_state(const Checkpoint_Header &header, Random_State *state) {
+    if(!memchr(header.mersenne, 0, sizeof(header.mersenne))) {
+        return false;
+    }
+    std::istringstream text(header.mersenne);
+    text >> state->mersenne;
+    state->rand_state = header.rand_state;
+    for_range(i, 0, 4) {
+        state->xoshiro.state[i] = header.xoshiro[i];
+    }
+    return !text.fail();
+}
+
+// Bytes of a block in the file, the blocks after it stay 8 byte aligned
+inline isize checkpoint_block_size(const Pool_Block_Header &header) {
+    isize size = sizeof(Checkpoint_Block) + sizeof(Pool_Block_Header) + header.capacity;
+    return (size + 7) & ~isize(7);
+}
+
+inline Chrono_Clock clock_after(Chrono_Clock clock, f64 seconds) {
+    return clock + std::chrono::duration_cast<Chrono_Clock::duration>(std::chrono::duration<f64>(seconds));
+}
+
+// Offsets of the written nodes by their address (open addressing with linear probing)
+struct Offset_Table {
+    Mcts_Node **keys = nullptr;
+    u64 *offsets = nullptr;
+    isize capacity = 0; // power of 2
+    isize count = 0;
+
+    isize slot_of(Mcts_Node *node) {
+        u64 hash = (u64(uintptr_t(node)) >> 4) * 0x9e3779b97f4a7c15;
+        isize slot = isize(hash >> 32) & (capacity - 1);
+        while(keys[slot] && keys[slot] != node) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        return slot;
+    }
+    // 0 if the node hasn't been written
+    u64 find(Mcts_Node *node) {
+        if(count == 0) return 0;
+        isize slot = slot_of(node);
+        return keys[slot] ? offsets[slot] : 0;
+    }
+    void add(Mcts_Node *node, u64 offset) {
+        if(2*(count + 1) > capacity) {
+            grow();
+        }
+        isize slot = slot_of(node);
+        assert(keys[slot] == nullptr);
+        keys[slot] = node;
+        offsets[slot] = offset;
+        count += 1;
+    }
+    void grow() {
+        Offset_Table grown = {};
+        grown.capacity = max<isize>(2*capacity, 1024);
+        grown.keys = mem_alloc<Mcts_Node *>(grown.capacity);
+        grown.offsets = mem_alloc<u64>(grown.capacity);
+        release_assert(grown.keys && grown.offsets, "checkpoint out of memory");
+        memset(grown.keys, 0, grown.capacity * sizeof(Mcts_Node *));
+        for_range(i, 0, capacity) {
+            if(keys[i]) {
+                isize slot = grown.slot_of(keys[i]);
+                grown.keys[slot] = keys[i];
+                grown.offsets[slot] = offsets[i];
+            }
+        }
+        grown.count = count;
+        destroy();
+        *this = grown;
+    }
+    void destroy() {
+        mem_free(keys);
+        mem_free(offsets);
+        *this = {};
+    }
+};
+
+struct Checkpoint_Writer {
+    FILE *file;
+    u64 size = 0;       // bytes of the blocks so far
+    i64 node_count = 0;
+    Offset_Table written;
+    Array<u64> children;
+    // the copy of the node with offsets instead of pointers
+    alignas(Mcts_Node) u8 node[mcts_node_size(MAX_CELL_COUNT, true)];
+    static_assert(mcts_node_size(MAX_CELL_COUNT, true) >= mcts_node_size(MAX_CELL_COUNT, false));
+
+    // Returns the offset of the data
+    u64 write_block(Checkpoint_Block_Kind kind, const void *data, isize count) {
+        static const u8 zeros[1024] = {};
+        Checkpoint_Block block = {kind, u32(count)};
+        Pool_Block_Header header = pool_block_header(count);
+        isize total = checkpoint_block_size(header);
+        fwrite(&block, sizeof(block), 1, file);
+        fwrite(&header, sizeof(header), 1, file);
+        fwrite(data, 1, count, file);
+        for(isize rest = total - sizeof(block) - sizeof(header) - count; rest > 0;) {
+            isize n = min<isize>(rest, sizeof(zeros));
+            fwrite(zeros, 1, n, file);
+            rest -= n;
+        }
+        u64 offset = size + sizeof(block) + sizeof(header);
+        size += total;
+        return offset;
+    }
+    // The children of the node have been written already
+    u64 write_node(Mcts_Node *node) {
+        const bool second = node->flags & MCTS_SECOND_ACTION;
+        const isize node_size = mcts_node_size(node->grid.get_count(), second);
+        memcpy(this->node, node, node_size);
+        auto copy = (Mcts_Node *)this->node;
+
+        if(node->children.data) {
+            children.count = 0;
+            children.reserve(node->children.capacity);
+            for_range(i, 0, node->children.count) {
+                u64 offset = written.find(node->children[i]);
+                assert(offset != 0);
+                children.add(offset);
+            }
+            for_range(i, node->children.count, node->children.capacity) {
+                children.add(0);
+            }
+            u64 offset = write_block(Checkpoint_Block_Kind::Children, children.data, children.count * sizeof(u64));
+            copy->children.data = (Mcts_Node **)uintptr_t(offset);
+        }
+        if(node->child_stats.data) {
+            isize count = node->child_stats.capacity * CHILD_STATS_SLOT_SIZE;
+            u64 offset = write_block(Checkpoint_Block_Kind::Data, node->child_stats.data, count);
+            copy->child_stats.data = (f64 *)uintptr_t(offset);
+        }
+        if(second) {
+            // moves() of the copy is found through its grid
+            copy->grid.data = (Pawn *)(copy + 1);
+            auto &moves = node->moves();
+            if(moves.data) {
+                u64 offset = write_block(Checkpoint_Block_Kind::Data, moves.data, moves.capacity * sizeof(Move_Info));
+                copy->moves().data = (Move_Info *)uintptr_t(offset);
+            }
+        }
+        copy->parent = nullptr;
+        copy->grid.data = nullptr;
+        copy->lock = {};
+        copy->flags &= ~MCTS_MARKED;
+        node_count += 1;
+        return write_block(Checkpoint_Block_Kind::Node, copy, node_size);
+    }
+};
+
+// The padding up to the offset
+static void write_zeros(FILE *file, isize count) {
+    static const u8 zeros[4096] = {};
+    while(count > 0) {
+        isize n = min<isize>(count, sizeof(zeros));
+        fwrite(zeros, 1, n, file);
+        count -= n;
+    }
+}
+
+bool save_mcts_checkpoint(Mcts *tree, const char *path) {
+    // The file is written next to path and replaces it at the end: a failed save keeps the old
+    // checkpoint and a tree loaded from path still has its blocks mapped from the old file.
+    char temp_path[1024];
+    if(snprintf(temp_path, sizeof(temp_path), "%s.tmp", path) >= int(sizeof(temp_path))) {
+        println("path too long:", path);
+        return false;
+    }
+    FILE *file = fopen(temp_path, "wb");
+    if(!file) {
+        println("couldn't open", temp_path);
+        return false;
+    }
+    // big buffer since the blocks are small writes
+    setvbuf(file, nullptr, _IOFBF, 1 << 20);
+    Checkpoint_Header header = {};
+    header.magic = CHECKPOINT_MAGIC;
+    header.version = CHECKPOINT_VERSION;
+    header.node_size = sizeof(Mcts_Node);
+    header.settings = checkpoint_settings();
+    header.level_count = u32(tree->finished_nodes.count);
+    header.config = tree->config;
+    header.seed = tree->seed;
+    header.best_score = tree->best_score;
+    header.elapsed = time_diff(tree->time_start, get_time());
+    header.prune_count = tree->prune_count;
+    header.pruned_node_count = tree->pruned_node_count;
+    header.start_position_tile = tree->start_position_tile;
+    header.start_position = tree->start_position;
+    header.last_rollout_depth = tree->last_rollout_depth;
+    write_random_state(header, get_random_state());
+    // the rest is known at the end
+    fwrite(&header, sizeof(header), 1, file);
+
+    isize position = sizeof(header);
+    for_range(i, 0, tree->finished_nodes.count) {
+        auto &level = tree->finished_nodes[i];
+        Checkpoint_Level info = {};
+        info.width = level.grid.width;
+        info.height = level.grid.height;
+        info.box_count = level.box_count;
+        info.score = level.score;
+        info.time = time_diff(tree->time_start, level.time_stamp);
+        info.hash = level.grid.hash;
+        fwrite(&info, sizeof(info), 1, file);
+        fwrite(level.grid.data, sizeof(Pawn), level.grid.get_count(), file);
+        position += sizeof(info) + sizeof(Pawn) * level.grid.get_count();
+    }
+    header.block_offset = (position + CHECKPOINT_ALIGNMENT - 1) & ~i64(CHECKPOINT_ALIGNMENT - 1);
+    write_zeros(file, header.block_offset - position);
+
+    // post-order with an explicit stack of the nodes and the index of their next child
+    struct Frame {
+        Mcts_Node *node;
+        isize next;
+    };
+    auto writer = mem_new<Checkpoint_Writer>();
+    writer->file = file;
+    writer->children = make_array<u64>(0, 64);
+    auto stack = make_array<Frame>(0, 256);
+    stack.add({tree->root, 0});
+    while(stack.count > 0) {
+        auto &frame = stack[stack.count - 1];
+        if(frame.next < frame.node->children.count) {
+            Mcts_Node *child = frame.node->children[frame.next];
+            frame.next += 1;
+            // a shared child might have been written already
+            if(!writer->written.find(child)) {
+                stack.add({child, 0});
+            }
+            continue;
+        }
+        Mcts_Node *node = frame.node;
+        stack.count -= 1;
+        writer->written.add(node, writer->write_node(node));
+    }
+    header.block_size = writer->size;
+    header.node_count = writer->node_count;
+    header.root = writer->written.find(tree->root);
+    stack.destroy();
+    writer->children.destroy();
+    writer->written.destroy();
+    mem_free(writer);
+
+    fseek(file, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, file);
+    bool ok = !ferror(file);
+    ok = (fclose(file) == 0) && ok;
+    if(!ok) {
+        println("couldn't write", temp_path);
+        remove(temp_path);
+        return false;
+    }
+    std::error_code error;
+    std::filesystem::rename(temp_path, path, error);
+    if(error) {
+        println("couldn't replace", path, "by", temp_path);
+        return false;
+    }
+    return true;
+}
+
+// Reads size bytes from offset of the file into memory the pool can adopt
+static void *map_checkpoint_blocks(FILE *file, i64 offset, i64 size) {
+    #ifdef _WIN32
+    void *blocks = global_default_allocator->_alloc(size);
+    if(!blocks) return nullptr;
+    if(_fseeki64(file, offset, SEEK_SET) != 0 || fread(blocks, 1, size, file) != usize(size)) {
+        global_default_allocator->_free(blocks);
+        return nullptr;
+    }
+    return blocks;
+    #else
+    void *blocks = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(file), offset);
+    return blocks == MAP_FAILED ? nullptr : blocks;
+    #endif // _WIN32
+}
+
+void free_checkpoint_blocks(Mcts *tree) {
+    if(!tree->checkpoint_blocks) {
+        return;
+    }
+    #ifdef _WIN32
+    global_default_allocator->_free(tree->checkpoint_blocks);
+    #else
+    munmap(tree->checkpoint_blocks, tree->checkpoint_size);
+    #endif // _WIN32
+    tree->checkpoint_blocks = nullptr;
+    tree->checkpoint_size = 0;
+}
+
+// Offset to pointer, false if it's outside of the blocks
+template<typename T>
+inline bool fix_pointer(T *&pointer, u8 *blocks, i64 size) {
+    u64 offset = u64(uintptr_t(pointer));
+    if(offset == 0) {
+        return true;
+    }
+    if(offset >= u64(size)) {
+        return false;
+    }
+    pointer = (T *)(blocks + offset);
+    return true;
+}
+
+// Adopts the blocks into the pool of the tree and turns the offsets into pointers
+static bool fix_checkpoint_blocks(Mcts *tree, const Checkpoint_Header &header) {
+    u8 *blocks = (u8 *)tree->checkpoint_blocks;
+    const i64 size = header.block_size;
+    auto pool = tree->node_allocator;
+    for(i64 position = 0; position < size;) {
+        if(position + i64(sizeof(Checkpoint_Block) + sizeof(Pool_Block_Header)) > size) {
+            return false;
+        }
+        auto block = (Checkpoint_Block *)(blocks + position);
+        isize total = checkpoint_block_size(pool_block_header(block->count));
+        if(position + total > size) {
+            return false;
+        }
+        void *data = pool->adopt(block + 1, block->count);
+        position += total;
+
+        if(block->kind == Checkpoint_Block_Kind::Node) {
+            auto node = (Mcts_Node *)data;
+            const bool second = node->flags & MCTS_SECOND_ACTION;
+            isize cell_count = node->grid.get_count();
+            if(cell_count < 0 || cell_count > MAX_CELL_COUNT || block->count != mcts_node_size(cell_count, second)) {
+                return false;
+            }
+            bool ok = fix_pointer(node->children.data, blocks, size);
+            ok = fix_pointer(node->child_stats.data, blocks, size) && ok;
+            if(second) {
+                node->grid.data = (Pawn *)(node + 1);
+                ok = fix_pointer(node->moves().data, blocks, size) && ok;
+            }
+            if(!ok) return false;
+        } else if(block->kind == Checkpoint_Block_Kind::Children) {
+            auto children = (Mcts_Node **)data;
+            for_range(i, 0, isize(block->count / sizeof(Mcts_Node *))) {
+                if(!fix_pointer(children[i], blocks, size)) return false;
+            }
+        } else if(block->kind != Checkpoint_Block_Kind::Data) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The parents from the children and the transposition table
+static void link_checkpoint_nodes(Mcts *tree, const Checkpoint_Header &header) {
+    u8 *blocks = (u8 *)tree->checkpoint_blocks;
+    for(i64 position = 0; position < header.block_size;) {
+        auto block = (Checkpoint_Block *)(blocks + position);
+        position += checkpoint_block_size(pool_block_header(block->count));
+        if(block->kind != Checkpoint_Block_Kind::Node) continue;
+
+        auto node = (Mcts_Node *)((Pool_Block_Header *)(block + 1) + 1);
+        for_range(i, 0, node->children.count) {
+            node->children[i]->parent = node;
+        }
+        // the root of a bootstrapped tree has no board and isn't part of the table
+        if(tree->transpositions && !(node->flags & MCTS_SECOND_ACTION) && node->grid.get_count() > 0) {
+            tree->transpositions->add(node);
+        }
+    }
+}
+
+Mcts *load_mcts_checkpoint(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if(!file) {
+        println("couldn't open", path);
+        return nullptr;
+    }
+    auto header = mem_new<Checkpoint_Header>();
+    Random_State random;
+    bool ok = fread(header, sizeof(*header), 1, file) == 1;
+    if(ok && (header->magic != CHECKPOINT_MAGIC || header->version != CHECKPOINT_VERSION)) {
+        println(path, "isn't a checkpoint of this version");
+        ok = false;
+    } else if(ok && (header->node_size != sizeof(Mcts_Node) || header->settings != checkpoint_settings())) {
+        println(path, "is a checkpoint of a build with other settings");
+        ok = false;
+    } else if(ok && header->random_engine != RANDOM_ENGINE) {
+        println(path, "is a checkpoint of a build with another RANDOM_ENGINE");
+        ok = false;
+    } else if(ok && !read_random_state(*header, &random)) {
+        println(path, "has a bad random state");
+        ok = false;
+    } else if(ok && (header->block_offset % CHECKPOINT_ALIGNMENT != 0 || header->root == 0 || !check_mcts_config(header->config))) {
+        ok = false;
+    }
+    if(!ok) {
+        println("couldn't load", path);
+        mem_free(header);
+        fclose(file);
+        return nullptr;
+    }
+
+    Mcts mcts = {};
+    mcts.finished_nodes = make_array<Level>(0, LEVEL_SET_SIZE);
+    mcts.time_start = clock_after(get_time(), -header->elapsed);
+    mcts.seed = header->seed;
+    init_mcts_from_config(mcts, header->config);
+    mcts.best_score = header->best_score;
+    mcts.prune_count = header->prune_count;
+    mcts.pruned_node_count = header->pruned_node_count;
+    mcts.start_position_tile = header->start_position_tile;
+    mcts.start_position = header->start_position;
+    mcts.last_rollout_depth = header->last_rollout_depth;
+    mcts.resume_random = mem_new<Random_State>();
+    *mcts.resume_random = random;
+    mcts.node_allocator = mem_new<Pool_Allocator>();
+    *mcts.node_allocator = make_pool_allocator(global_default_allocator, node_pool_chunk_size(header->config));
+    #if TRANSPOSITION_TABLE
+    isize capacity = 1024;
+    while(capacity < 2*header->node_count) {
+        capacity *= 2;
+    }
+    mcts.transpositions = mem_new<Transposition_Table>();
+    *mcts.transpositions = make_transposition_table(global_default_allocator, capacity);
+    #endif // TRANSPOSITION_TABLE
+    auto tree = mem_alloc<Mcts>();
+    *tree = mcts;
+
+    for_range(i, 0, isize(header->level_count)) {
+        Checkpoint_Level info;
+        if(fread(&info, sizeof(info), 1, file) != 1 || info.width <= 0 || info.height <= 0 || info.width*info.height > MAX_CELL_COUNT) {
+            ok = false;
+            break;
+        }
+        Level level = {};
+        level.grid = make_grid(info.width, info.height);
+        level.box_count = info.box_count;
+        level.score = info.score;
+        level.time_stamp = clock_after(tree->time_start, info.time);
+        if(fread(level.grid.data, sizeof(Pawn), level.grid.get_count(), file) != usize(level.grid.get_count())) {
+            level.grid.destroy();
+            ok = false;
+            break;
+        }
+        level.grid.hash = info.hash;
+        if(tree->make_room_for_level(grid_symmetry_hash(level.grid), level.score)) {
+            tree->push_finished_level(level);
+        } else {
+            level.grid.destroy();
+        }
+    }
+    if(ok) {
+        tree->checkpoint_blocks = map_checkpoint_blocks(file, header->block_offset, header->block_size);
+        ok = tree->checkpoint_blocks != nullptr;
+    }
+    if(ok) {
+        tree->checkpoint_size = header->block_size;
+        ok = fix_checkpoint_blocks(tree, *header) && header->root < u64(header->block_size);
+    }
+    if(ok) {
+        link_checkpoint_nodes(tree, *header);
+        tree->root = (Mcts_Node *)((u8 *)tree->checkpoint_blocks + header->root);
+        tree->root->parent = nullptr;
+    }
+    fclose(file);
+    mem_free(header);
+    if(!ok) {
+        println("couldn't load", path);
+        delete_mcts(tree);
+        return nullptr;
+    }
+    return tree;
+}
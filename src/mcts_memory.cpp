@@ -0,0 +1,180 @@
+#include "mcts.h"
+#include "settings.h"
+#include "allocator.h"
+#include "transposition.h"
+#include <algorithm>
+/*
+    Memory budget (Mcts_Config::memory_budget): after a rollout that leaves the nodes above it,
+    prune_tree collapses the least visited subtrees until they are below 3/4 of the budget.
+
+    - A collapsed node keeps its statistics but loses its children and its actions,
+      the next selection that reaches it blooms it again like a new leaf.
+    - The nodes with children (but the root) are collapsed in the order of their rollout counts
+      and the prune stops as soon as the target is reached. At the same count the deeper
+      ones (later in pre-order) go first, so in a tree the descendants of a node have been
+      collapsed before it and a collapse never frees a node that is still to come.
+    - With a transposition table a first phase child is only freed if no other parent has it as a child
+      (see Mcts_Node::parent_count), it's removed from the table then.
+      Shared children which stay lose the parent they were created from, that one is only used
+      by the backup of the second phase.
+      A freed child can have more rollouts than the collapsed parent, if it's still to come it's only
+      collapsed then and freed at the end of the prune.
+    - The budget is compared with the blocks in use (tree_memory_size). The freed blocks go back to
+      the node pool and are reused by the next nodes, the chunks of the pool which are free
+      as a whole go back to the process (see Pool_Allocator::release_free_chunks).
+      After the first prune the pool splits bigger free blocks instead of taking another chunk
+      beyond the budget (Pool_Allocator::reserve_limit) and its chunks are at most 1/16 of the
+      budget (node_pool_chunk_size), what it reserves stays a bit above the budget.
+      A split block counts as the class it has been asked for: the size in use doesn't depend on
+      the free blocks and a loaded checkpoint prunes after the same rollouts.
+      The transposition table counts as well, it's shrunk before the nodes are collapsed.
+
+    The tree must not be shared between threads (see check_mcts_config).
+*/
+
+isize tree_memory_size(Mcts *tree) {
+    isize size = tree->node_allocator->in_use;
+    if(tree->transpositions) {
+        size += tree->transpositions->capacity * sizeof(Mcts_Node *);
+    }
+    return size;
+}
+
+isize tree_reserved_size(Mcts *tree) {
+    isize size = tree->node_allocator->reserved + tree->checkpoint_size;
+    if(tree->transpositions) {
+        size += tree->transpositions->capacity * sizeof(Mcts_Node *);
+    }
+    return size;
+}
+
+isize node_pool_chunk_size(const Mcts_Config &config) {
+    if(config.memory_budget <= 0) {
+        return POOL_CHUNK_SIZE;
+    }
+    // at most 1/16 of the budget
+    return clamp<isize>(isize(config.memory_budget * 1e6) / 16, 64 << 10, POOL_CHUNK_SIZE);
+}
+
+// Frees the children of node which no other node has and makes it a leaf, returns the freed count.
+// A freed node that is still to come (MCTS_MARKED) is only collapsed and goes to deferred,
+// which has room for every candidate. The node pool has to be the current allocator.
+static isize collapse_node(Mcts *tree, Mcts_Node *node, Array<Mcts_Node *> &deferred) {
+    isize freed = 0;
+    for_range(i, 0, node->children.count) {
+        Mcts_Node *child = node->children[i];
+        if(tree->transpositions && !(child->flags & MCTS_SECOND_ACTION)) {
+            assert(child->parent_count > 0);
+            child->parent_count -= 1;
+            if(child->parent_count > 0) {
+                if(child->parent == node) {
+                    child->parent = nullptr;
+                }
+                continue;
+            }
+            tree->transpositions->remove(child);
+        }
+        freed += collapse_node(tree, child, deferred) + 1;
+        if(child->flags & MCTS_MARKED) {
+            assert(deferred.count < deferred.capacity);
+            deferred.add(child);
+        } else {
+            mem_free(child);
+        }
+    }
+    node->children.destroy();
+    if(node->child_stats.data) {
+        mem_free(node->child_stats.data);
+        node->child_stats = {};
+    }
+    if(node->flags & MCTS_SECOND_ACTION) {
+        node->moves().destroy();
+        node->flags &= ~(MCTS_BLOOMED | MCTS_EXPANDED | MCTS_EVALUATED);
+    } else {
+        // first_set and second_set are next to each other
+        auto first = node->first_set();
+        memset(first.words, 0, 2 * first.word_count * sizeof(u64));
+        node->flags &= ~(MCTS_BLOOMED | MCTS_EXPANDED | MCTS_CAN_FREEZE | MCTS_FROZEN);
+    }
+    return freed;
+}
+
+// Halves the capacity of the table while it's less than 1/8 full
+static void shrink_transposition_table(Mcts *tree) {
+    auto table = tree->transpositions;
+    if(!table) {
+        return;
+    }
+    isize capacity = table->capacity;
+    while(capacity > 1024 && 8*table->count < capacity) {
+        capacity /= 2;
+    }
+    if(capacity < table->capacity) {
+        table->resize(capacity);
+    }
+}
+
+void prune_tree(Mcts *tree) {
+    const isize budget = isize(tree->config.memory_budget * 1e6);
+    const isize target = budget / 4 * 3;
+    shrink_transposition_table(tree);
+
+    // The nodes with children in pre-order, every one once (MCTS_MARKED)
+    struct Candidate {
+        i32 rollout_count;
+        i32 order;
+        Mcts_Node *node;
+    };
+    auto candidates = make_array<Candidate>(0, 1024);
+    auto stack = make_array<Mcts_Node *>(0, 256);
+    stack.add(tree->root);
+    while(stack.count > 0) {
+        Mcts_Node *node = stack[stack.count - 1];
+        stack.count -= 1;
+        for_range(i, 0, node->children.count) {
+            Mcts_Node *child = node->children[i];
+            if(child->children.count == 0 || (child->flags & MCTS_MARKED)) continue;
+            child->flags |= MCTS_MARKED;
+            candidates.add({child->rollout_count, i32(candidates.count), child});
+            stack.add(child);
+        }
+    }
+    std::sort(candidates.data, candidates.data + candidates.count, [](const Candidate &a, const Candidate &b) {
+        return a.rollout_count < b.rollout_count || (a.rollout_count == b.rollout_count && a.order > b.order);
+    });
+    auto deferred = make_array<Mcts_Node *>(0, max<isize>(candidates.count, 1));
+
+    isize freed = 0;
+    i32 max_rollout_count = 0;
+    Allocator *previous_allocator = set_allocator(tree->node_allocator);
+    for(isize i = 0; i < candidates.count && tree_memory_size(tree) > target; i += 1) {
+        Mcts_Node *node = candidates[i].node;
+        // collapsed by one of its parents
+        if(node->children.count == 0) continue;
+        freed += collapse_node(tree, node, deferred);
+        max_rollout_count = candidates[i].rollout_count;
+    }
+    // the deferred nodes are candidates as well, so they are still there
+    for_range(i, 0, candidates.count) {
+        candidates[i].node->flags &= ~MCTS_MARKED;
+    }
+    for_range(i, 0, deferred.count) {
+        mem_free(deferred[i]);
+    }
+    set_allocator(previous_allocator);
+    shrink_transposition_table(tree);
+    tree->node_allocator->release_free_chunks();
+    // from now on the pool only grows beyond the budget if there is no free block to split
+    isize other_size = tree_reserved_size(tree) - tree->node_allocator->reserved;
+    tree->node_allocator->reserve_limit = max<isize>(budget - other_size, 1);
+    candidates.destroy();
+    stack.destroy();
+    deferred.destroy();
+
+    tree->prune_count += 1;
+    tree->pruned_node_count += freed;
+    if(!tree->quiet) {
+        println("memory budget: freed", freed, "nodes with up to", max_rollout_count, "rollouts | MB:",
+            f64(tree_memory_size(tree))/1e6, "| reserved MB:", f64(tree_reserved_size(tree))/1e6);
+    }
+}
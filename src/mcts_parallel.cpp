@@ -0,0 +1,91 @@
+#include "mcts.h"
+#include "mcts_actions.h"
+#include "settings.h"
+#include "allocator.h"
+/*
+    Tree parallelization: multiple threads run uct_body_parallel on the same tree.
+
+    - Every node has a spin lock which guards bloom and the expansion of the node.
+      A node gets bloomed exactly once and its children array only grows while the lock is held.
+      Once can_expand returns false the children array is never touched again, which
+      is why best_child can read it without the lock afterwards.
+    - The statistics (score_sum, squared_score_sum, rollout_count) and their slots in the child_stats
+      of the parent are updated with atomics. The slots get their block with the first child
+      (see add_child_stats), it doesn't move afterwards.
+    - While a rollout is in flight its path carries VIRTUAL_LOSS extra visits with a score of 0,
+      so the other threads are less likely to descend into the same branch.
+    - best_score/finished_nodes are guarded by Mcts::level_lock (see default_policy).
+    - Every thread uses its own arena and random engine (see init_thread_allocators).
+      The node pool of the tree is shared and locks itself (Pool_Allocator::thread_safe).
+
+    Nodes that can't be expanded after their bloom aren't being pruned like in bloom_and_check_expand
+    since other threads could currently be inside of them. They are simply scored with DEAD_END_SCORE.
+*/
+
+inline void add_virtual_loss(Mcts_Node *node) {
+    add_node_stats_atomic(node, 0, 0, VIRTUAL_LOSS);
+}
+
+template<typename Policy>
+Mcts_Node *tree_policy_parallel(Mcts_Node *, Mcts *, Policy, bool *);
+
+template<typename Policy>
+void uct_body_parallel(Mcts *tree, Policy decision) {
+    bool dead_end = false;
+    Allocator *previous_allocator = set_allocator(tree->node_allocator);
+    auto node = tree_policy_parallel(tree->root, tree, decision, &dead_end);
+    set_allocator(previous_allocator);
+    f64 score = DEAD_END_SCORE;
+    if(!dead_end) {
+        score = default_policy(node, tree);
+    }
+    node->add_score_and_propagate_parallel(score);
+}
+void uct_body_parallel(Mcts *tree, const Decision_Proc decision) {
+    with_decision_policy(decision, [&](auto policy) {
+        uct_body_parallel(tree, policy);
+    });
+}
+
+template<typename Policy>
+Mcts_Node *tree_policy_parallel(Mcts_Node *node, Mcts *tree, Policy decision, bool *dead_end) {
+    add_virtual_loss(node);
+    while(true) {
+        node->lock.lock();
+        if(node->flags & MCTS_TERMINAL) {
+            node->lock.unlock();
+            return node;
+        }
+        if(!is_bloomed(node)) {
+            bloom(node, tree);
+        }
+        if(node->can_expand()) {
+            #if TREE_POLICY_NEXT == true
+                auto child = expand_next(node, tree);
+            #else
+                auto child = expand_random(node, tree);
+            #endif
+            add_child_stats(node);
+            // the child is visible to the other threads once we unlock
+            add_virtual_loss(child);
+            node->lock.unlock();
+            return child;
+        }
+        node->lock.unlock();
+        if(node->children.count == 0) {
+            *dead_end = true;
+            return node;
+        }
+        node = best_child(node, tree, decision);
+        add_virtual_loss(node);
+    }
+}
+
+void Mcts_Node::add_score_and_propagate_parallel(f64 score) {
+    auto squared = score*score;
+
+    // the visits themselves have already been added as virtual loss
+    for(auto node = this; node; node = node->parent) {
+        add_node_stats_atomic(node, score, squared, 1 - VIRTUAL_LOSS);
+    }
+}
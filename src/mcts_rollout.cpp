@@ -0,0 +1,121 @@
+#include "mcts.h"
+#include "mcts_actions.h"
+#include "settings.h"
+/*
+    The simulation of default_policy without allocating nodes (Mcts_Config::scratch_rollout).
+
+    Every node of a simulation only ever gets one child, so instead of a chain of cloned nodes
+    a rollout works on the scratch nodes of its thread, which every rollout reuses:
+    - The first phase alternates between two bitboard nodes. An action copies the board into
+      the other one and is applied there, the node before keeps its board and the actions it has left.
+      That's all the undo a rollout needs: bloom_and_check_expand only ever goes back to the parent
+      of a node which can't be expanded, the rollout switches back to it.
+    - The second phase never goes back, its actions are applied to a single node in place.
+      The moves are kept in a buffer instead of moves().
+    The actions are the apply_* of mcts_actions.h and pick_random_action takes the same random
+    numbers as expand_random, so the rollout ends in the same level as one on cloned nodes.
+*/
+
+struct Rollout_Scratch {
+    alignas(Mcts_Node) u8 first[2][mcts_node_size(MAX_CELL_COUNT, false)];
+    alignas(Mcts_Node) u8 second[mcts_node_size(MAX_CELL_COUNT, true)];
+    Move_Info moves[MAX_MOVE_COUNT];
+};
+thread_local Rollout_Scratch rollout_scratch;
+
+// The second phase node goes on with the child of the action
+inline void next_second_phase_node(Mcts_Node *node) {
+    node->flags = MCTS_SECOND_ACTION;
+    node->depth += 1;
+}
+
+Mcts_Node *rollout_in_place(Mcts_Node *base, Mcts *tree) {
+    assert(!is_terminal(base));
+    auto &scratch = rollout_scratch;
+    const i32 width = base->grid.width;
+    const i32 height = base->grid.height;
+    const isize cell_count = base->grid.get_count();
+    Mcts_Node *first[2] = {(Mcts_Node *)scratch.first[0], (Mcts_Node *)scratch.first[1]};
+    Mcts_Node *second = (Mcts_Node *)scratch.second;
+    isize move_count = 0;
+
+    // A copy of base like clone_mcts_node.
+    // In a shared tree another thread might bloom base in the meantime.
+    Mcts_Node *node;
+    if(TREE_PARALLEL) base->lock.lock();
+    assert(base->children.count == 0 || TREE_PARALLEL);
+    if(base->flags & MCTS_SECOND_ACTION) {
+        node = second;
+        init_mcts_node(node, width, height, true);
+        memcpy(node->grid.data, base->grid.data, cell_count);
+        memcpy(node->first_table(), base->first_table(), 2 * cell_count);
+        move_count = base->moves().count;
+        if(move_count > 0) {
+            memcpy(scratch.moves, base->moves().data, move_count * sizeof(Move_Info));
+        }
+    } else {
+        node = first[0];
+        init_mcts_node(node, width, height, false);
+        memcpy(node + 1, base + 1, mcts_node_size(cell_count, false) - sizeof(Mcts_Node));
+    }
+    node->flags = base->flags;
+    node->grid.hash = base->grid.hash;
+    node->box_count = base->box_count;
+    node->depth = base->depth;
+    node->pusher = base->pusher;
+    if(TREE_PARALLEL) base->lock.unlock();
+
+    // The first phase node node is the child of, nullptr if there is none to go back to
+    Mcts_Node *parent = nullptr;
+    while(!(node->flags & MCTS_TERMINAL)) {
+        if(!is_bloomed(node)) {
+            if(node->flags & MCTS_SECOND_ACTION) {
+                // see bloom
+                move_count = find_agent_moves(*node, tree, scratch.moves);
+                node->flags |= MCTS_BLOOMED;
+            } else {
+                bloom(node, tree);
+                // see bloom_and_check_expand
+                if(!node->can_expand()) {
+                    if(!parent || !parent->can_expand()) {
+                        return nullptr;
+                    }
+                    node = parent;
+                    parent = nullptr;
+                }
+            }
+            continue;
+        }
+        auto action = pick_random_action(node, move_count);
+        if(action == Mcts_Action::Delete_Obstacle || action == Mcts_Action::Place_Box) {
+            Mcts_Node *child = (node == first[0]) ? first[1] : first[0];
+            init_mcts_node(child, width, height, false);
+            copy_to_child_node(*node, child);
+            if(action == Mcts_Action::Delete_Obstacle) {
+                apply_delete_obstacle(*node, *child);
+            } else {
+                apply_place_box(*node, *child);
+            }
+            parent = node;
+            node = child;
+        } else if(action == Mcts_Action::Freeze_Level) {
+            init_mcts_node(second, width, height, true);
+            copy_to_child_node(*node, second);
+            apply_freeze_level(*node, second, tree);
+            parent = nullptr;
+            node = second;
+        } else if(action == Mcts_Action::Move_Agent) {
+            auto index = random_index(move_count);
+            next_second_phase_node(node);
+            apply_move_agent(node, scratch.moves[index], tree);
+            if_debug {
+                debug_check_box_count(*node, "rollout move");
+                debug_check_hash(*node, "rollout move");
+            }
+        } else {
+            next_second_phase_node(node);
+            apply_evaluate_level(node, tree);
+        }
+    }
+    return node;
+}
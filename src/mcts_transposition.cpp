@@ -0,0 +1,231 @@
+#include "mcts.h"
+#include "mcts_actions.h"
+#include "settings.h"
+#include "allocator.h"
+#include "transposition.h"
+/*
+    Transpositions: the same first phase board can be reached through different orders of
+    delete obstacle and place box. With TRANSPOSITION_TABLE these nodes are shared, which turns
+    the tree into a DAG. uct_body_transposition replaces uct_body then (see Mcts::next_rollout).
+
+    - Only first phase nodes are in the table. Their state is the block and box planes,
+      the pusher is always the start position and the depth follows from the planes.
+      Second phase nodes depend on the path through their tables and are never shared.
+    - The parent of a node stays the one it was created from, other parents only point to it
+      through their children. The backup follows the Tree_Path of the rollout instead
+      and the selection policy gets the parent the rollout came from.
+      The slots in the child_stats of a parent belong to the edges (see Child_Stats): best_child compares
+      the rollouts that went from this parent through a child with the rollouts of the parent, not the ones
+      of a shared child through all its parents.
+    - Nodes that can't be expanded after their bloom aren't being pruned like in bloom_and_check_expand
+      since other parents might still point to them. They are simply scored with DEAD_END_SCORE (as in mcts_parallel.cpp).
+      Shared nodes are freed together with the node pool or by prune_tree once none of their
+      parents has them as a child anymore (see parent_count).
+
+    Tree parallelization doesn't use the table.
+*/
+
+Transposition_Table make_transposition_table(Allocator *allocator, isize capacity) {
+    assert(capacity > 0 && (capacity & (capacity - 1)) == 0);
+    Transposition_Table table = {};
+    table.allocator = allocator;
+    table.capacity = capacity;
+    table.nodes = (Mcts_Node **)allocator->_alloc(capacity * sizeof(Mcts_Node *));
+    release_assert(table.nodes, "transposition table out of memory");
+    memset(table.nodes, 0, capacity * sizeof(Mcts_Node *));
+    return table;
+}
+
+inline bool same_first_phase_board(Mcts_Node *a, Mcts_Node *b) {
+    auto a_block = a->block_set();
+    auto b_block = b->block_set();
+    assert(a_block.word_count == b_block.word_count);
+    // block_set and box_set are next to each other
+    return memcmp(a_block.words, b_block.words, 2 * a_block.word_count * sizeof(u64)) == 0;
+}
+
+Mcts_Node *Transposition_Table::find(Mcts_Node *node) {
+    isize mask = capacity - 1;
+    for(isize i = node->grid.hash & mask; nodes[i]; i = (i + 1) & mask) {
+        Mcts_Node *it = nodes[i];
+        if(it->grid.hash == node->grid.hash && same_first_phase_board(it, node)) {
+            return it;
+        }
+    }
+    return nullptr;
+}
+
+void Transposition_Table::add(Mcts_Node *node) {
+    assert(!(node->flags & MCTS_SECOND_ACTION));
+    assert(node->grid.hash == zobrist_hash(*node));
+    if(2*(count + 1) > capacity) {
+        grow();
+    }
+    isize mask = capacity - 1;
+    isize i = node->grid.hash & mask;
+    while(nodes[i]) {
+        assert(nodes[i] != node);
+        i = (i + 1) & mask;
+    }
+    nodes[i] = node;
+    count += 1;
+}
+
+// Backward shift deletion: the following nodes of the cluster which may be in the hole are moved into it
+void Transposition_Table::remove(Mcts_Node *node) {
+    isize mask = capacity - 1;
+    isize hole = node->grid.hash & mask;
+    while(nodes[hole] != node) {
+        assert(nodes[hole]);
+        hole = (hole + 1) & mask;
+    }
+    for(isize i = (hole + 1) & mask; nodes[i]; i = (i + 1) & mask) {
+        isize home = nodes[i]->grid.hash & mask;
+        // the hole is between home and i
+        if(((i - home) & mask) >= ((i - hole) & mask)) {
+            nodes[hole] = nodes[i];
+            hole = i;
+        }
+    }
+    nodes[hole] = nullptr;
+    count -= 1;
+}
+
+void Transposition_Table::grow() {
+    resize(2*capacity);
+}
+
+void Transposition_Table::resize(isize new_capacity) {
+    assert(2*count <= new_capacity);
+    auto old = *this;
+    *this = make_transposition_table(allocator, new_capacity);
+    isize mask = capacity - 1;
+    for_range(j, 0, old.capacity) {
+        Mcts_Node *it = old.nodes[j];
+        if(!it) continue;
+        isize i = it->grid.hash & mask;
+        while(nodes[i]) {
+            i = (i + 1) & mask;
+        }
+        nodes[i] = it;
+    }
+    count = old.count;
+    old.destroy();
+}
+
+void Transposition_Table::destroy() {
+    if(nodes) {
+        allocator->_free(nodes);
+    }
+    *this = {};
+}
+
+// child has just been added to parent by an expansion.
+// If its board is already in the table the child is replaced with the node of the table,
+// else it's being added.
+Mcts_Node *share_transposition(Mcts *tree, Mcts_Node *parent, Mcts_Node *child) {
+    if(child->flags & MCTS_SECOND_ACTION) {
+        return child;
+    }
+    auto table = tree->transpositions;
+    auto existing = table->find(child);
+    if(!existing) {
+        table->add(child);
+        child->parent_count = 1;
+        return child;
+    }
+    assert(parent->children[parent->children.count - 1] == child);
+    parent->children[parent->children.count - 1] = existing;
+    // every parent reaches it by another cell, so there are less than MAX_CELL_COUNT
+    assert(existing->parent_count < 255);
+    existing->parent_count += 1;
+    child->destroy();
+    mem_free(child);
+    return existing;
+}
+
+template<typename Policy>
+Mcts_Node *tree_policy_transposition(Mcts_Node *, Mcts *, Policy, Tree_Path *, bool *);
+
+template<typename Policy>
+f64 uct_body_transposition(Mcts *tree, Policy decision) {
+    Tree_Path path;
+    bool dead_end = false;
+    Allocator *previous_allocator = set_allocator(tree->node_allocator);
+    auto node = tree_policy_transposition(tree->root, tree, decision, &path, &dead_end);
+    set_allocator(previous_allocator);
+    tree->last_rollout_depth = node->depth;
+    f64 score = DEAD_END_SCORE;
+    if(!dead_end) {
+        score = default_policy(node, tree);
+    }
+    add_score_and_propagate_path(node, path, score);
+    return score;
+}
+f64 uct_body_transposition(Mcts *tree, const Decision_Proc decision) {
+    f64 score;
+    with_decision_policy(decision, [&](auto policy) {
+        score = uct_body_transposition(tree, policy);
+    });
+    return score;
+}
+
+template<typename Policy>
+Mcts_Node *tree_policy_transposition(Mcts_Node *node, Mcts *tree, Policy decision, Tree_Path *path, bool *dead_end) {
+    // index of node in the children of the previous one
+    isize slot = -1;
+    while( !(node->flags & MCTS_TERMINAL)) {
+        if(!(node->flags & MCTS_SECOND_ACTION)) {
+            path->add(node, slot);
+        }
+        if(!is_bloomed(node)) {
+            bloom(node, tree);
+        }
+        if(node->can_expand()) {
+            #if TREE_POLICY_NEXT == true
+                auto child = expand_next(node, tree);
+            #else
+                auto child = expand_random(node, tree);
+            #endif
+            auto shared = share_transposition(tree, node, child);
+            slot = node->children.count - 1;
+            add_child_stats(node, !(shared->flags & MCTS_SECOND_ACTION));
+            if(shared == child) {
+                if(!(child->flags & MCTS_SECOND_ACTION)) {
+                    path->add(child, slot);
+                }
+                return child;
+            }
+            // The board is known already: continue the selection from there
+            node = shared;
+            continue;
+        }
+        if(node->children.count == 0) {
+            *dead_end = true;
+            return node;
+        }
+        slot = best_child_index(node, tree, decision);
+        node = node->children[slot];
+    }
+    return node;
+}
+
+// The second phase part of the path is a tree and follows the parents,
+// the first phase part and the edge slots are taken from the path.
+void add_score_and_propagate_path(Mcts_Node *node, Tree_Path &path, f64 score) {
+    auto squared = score*score;
+
+    auto update = [&](Mcts_Node *it) {
+        add_node_stats(it, score, squared, 1);
+    };
+    for(; node->flags & MCTS_SECOND_ACTION; node = node->parent) {
+        update(node);
+    }
+    assert(path.count > 0 && path.nodes[path.count - 1] == node);
+    for(isize i = path.count - 1; i >= 0; i -= 1) {
+        update(path.nodes[i]);
+        if(i > 0) {
+            path.nodes[i - 1]->child_stats.add(path.slots[i], score, squared, 1);
+        }
+    }
+}
@@ -8,8 +8,12 @@ void print_move_infos(Array<Move_Info> &e, Grid &grid) {
 void print_node_debug(Mcts_Node &node) {
     println("~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~");
     println(node.grid.as_tile(node.pusher));
-    println(node.grid);
-    print_move_infos(node.moves, node.grid);
+    Grid grid = get_node_grid(node);
+    println(grid);
+    grid.destroy();
+    if(node.flags & MCTS_SECOND_ACTION) {
+        print_move_infos(node.moves(), node.grid);
+    }
     println("~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~");
 }
 
@@ -31,9 +35,11 @@ void print_node(Mcts_Node &node) {
         Mcts_Node *it = node.children[i];
         print("\n", bool(it->flags & MCTS_EXPANDED), ", ", bool(it->flags & MCTS_SECOND_ACTION) , ", ", it->score_sum, ", ", it->rollout_count, ", ", it->children.count, ", ", it->depth);
 
-        String string = str(it->grid);
+        Grid grid = get_node_grid(*it);
+        String string = str(grid);
         println(string);
         string.destroy();
+        grid.destroy();
         print_node(*it);
     }
     println("--------------------------------------");
@@ -51,9 +57,11 @@ void print_scored_nodes(Mcts_Node &node) {
         if(it->score_sum <=0) continue;
         print("\n",bool(it->flags & MCTS_TERMINAL) , ", ", it->score_sum, ", ", it->rollout_count, ", ", (it->children.count>0));
 
-        String string = str(it->grid);
+        Grid grid = get_node_grid(*it);
+        String string = str(grid);
         println(string);
         string.destroy();
+        grid.destroy();
         print_scored_nodes(*it);
     }
     println("--------------------------------------");
@@ -41,9 +41,33 @@
 #define LEVEL_SET_SIZE 30
 // If true prints when a new good level is being added
 #define PRINT_NEW_LEVEL_INFO true
+// If true every level that is being added during the search is written right away to
+// saved_levels/stream_<seed>.txt by a separate thread (see level_stream.h)
+#define STREAM_LEVELS false
 
 // If it is set to 0 a random seed will be generated else it uses the seed
 #define DEFAULT_SEED 0 
+
+// Number of independent trees that are being searched in parallel (root parallelization).
+// Each tree runs on its own thread with its own seed (seed + i), arena and random engine.
+// Their levels are merged at the end.
+// Set to 0 to use all available cores, 1 is single threaded.
+#define THREAD_COUNT 1
+// If true the THREAD_COUNT threads share one tree instead (tree parallelization).
+// See mcts_parallel.cpp.
+#define TREE_PARALLEL false
+// Visits a rollout adds to its path (with score 0) while it is in flight.
+// Steers the other threads of a shared tree into different branches.
+#define VIRTUAL_LOSS 1
+// Shares the first phase nodes with the same board between their parents, the tree becomes a DAG.
+// See mcts_transposition.cpp. Not used by the tree parallelization.
+// Opt-in like RANDOM_XOSHIRO since the search is a different one and a seed gets other levels:
+// dead ends are scored with DEAD_END_SCORE instead of being pruned and a shared node has
+// the visits of all its parents.
+#define TRANSPOSITION_TABLE false
+// The score a rollout gets when the tree policy ends in a dead end of a shared tree or DAG.
+// The plain tree prunes dead ends instead, which isn't possible while other threads or parents point to them.
+#define DEAD_END_SCORE 0.0
 // Use the simple move action implementation (tile by tile) meant for experiments
 #define USE_SIMPLE_MOVES false
 
@@ -58,9 +82,17 @@ inline double MCTS_BOOTSTRAP_DELTA = 0.05;
 // see sokoban_example_levels
 #define USE_EXAMPLE_LEVELS false
 
-// Enables usage of the arena allocator during default policy
+// Enables usage of the arena allocator during default policy on cloned nodes (SCRATCH_ROLLOUT false).
+// The scratch rollout doesn't allocate, with it the arena stays empty and doesn't take any memory.
 #define ARENA_ALLOCATOR true
 
+// MB the tree may use, above it the least visited subtrees are collapsed (see prune_tree). 0: no limit
+#define MEMORY_BUDGET 0
+
+// The default policy simulates on reused scratch nodes instead of cloned ones (see mcts_rollout.cpp).
+// It doesn't allocate then, ARENA_ALLOCATOR only matters without it.
+#define SCRATCH_ROLLOUT true
+
 
 // Simulation count is being used if DEFAULT_TIMEOUT == 0
 // Bootstrap does not work with this
@@ -71,6 +103,10 @@ inline double MCTS_BOOTSTRAP_DELTA = 0.05;
 // Activates removal of impossible configurations
 #define REMOVE_IMPOSSIBLE true
 
+// Uses the SSE2/AVX2 version of area_score_of_v2 for the scoring (see area_score_of_v2_simd).
+// AVX2 needs the scons argument avx2=1, without SSE2 it falls back to the scalar version.
+#define SIMD_AREA_SCORE true
+
 
 inline int32_t DEPTH_LOWER_CUTOFF = 10;
 
@@ -85,9 +121,17 @@ inline int32_t BOX_UPPER_CUTOFF = -1;
 // FREEZE-LEVEL has to have at least that many boxes
 inline int32_t BOX_LOWER_CUTOFF = 1;
 
+// Random engine that is used by the actions and rollouts
+#define RANDOM_RAND 0     // the lcg of rand with a state per thread (see util.cpp)
+#define RANDOM_MERSENNE 1 // std::mt19937
+#define RANDOM_XOSHIRO 2  // xoshiro256** (around 2x faster than mersenne, see util.h)
+// The levels of a seed (and saved checkpoints) depend on the engine,
+// xoshiro is opt-in so that the seeds of the experiments keep their levels.
+#define RANDOM_ENGINE RANDOM_MERSENNE
 // true:  use mersenne twister
 // false: use rand
-#define MT_RANDOM true
+// Only kept for experiment_rng
+#define MT_RANDOM (RANDOM_ENGINE == RANDOM_MERSENNE)
 
 // true:  expands next action type in tree policy
 // false: expands totally random
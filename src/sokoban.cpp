@@ -158,6 +158,8 @@ Grid make_grid(i32 width, i32 height) {
 	grid.width = width;
 	grid.height = height;
 	grid.data = make_zeroed_array<Pawn>(width*height);
+	// the empty pawn has no keys
+	grid.hash = 0;
 	return grid;
 }
 Grid clone_grid(Grid &base) {
@@ -165,8 +167,58 @@ Grid clone_grid(Grid &base) {
 	grid.width = base.width;
 	grid.height = base.height;
 	grid.data = clone_array(base.data, base.get_count());
+	grid.hash = base.hash;
 	return grid;
 }
+// Full computation, Grid::set updates the hash incrementally
+u64 grid_hash(const Grid &grid) {
+	u64 hash = 0;
+	for_range(i, 0, grid.get_count()) {
+		hash ^= zobrist_pawn_key(i, grid.data[i]);
+	}
+	return hash;
+}
+// Smallest hash over the rotations and reflections of the grid which keep its size
+// (all 8 for square grids, else the two flips and the half turn besides the identity).
+// Equivalent levels have the same one.
+u64 grid_symmetry_hash(const Grid &grid) {
+	i32 w = grid.width;
+	i32 h = grid.height;
+	u64 hashes[8] = {};
+	for_range(y, 0, h) {
+		for_range(x, 0, w) {
+			Pawn pawn = grid.data[y*w + x];
+			if(pawn == Pawn::Empty) continue;
+			i32 rx = w-1 - x;
+			i32 ry = h-1 - y;
+			hashes[0] ^= zobrist_pawn_key(y*w + x, pawn);
+			hashes[1] ^= zobrist_pawn_key(y*w + rx, pawn);
+			hashes[2] ^= zobrist_pawn_key(ry*w + x, pawn);
+			hashes[3] ^= zobrist_pawn_key(ry*w + rx, pawn);
+			if(w == h) {
+				// x and y swapped
+				hashes[4] ^= zobrist_pawn_key(x*w + y, pawn);
+				hashes[5] ^= zobrist_pawn_key(x*w + ry, pawn);
+				hashes[6] ^= zobrist_pawn_key(rx*w + y, pawn);
+				hashes[7] ^= zobrist_pawn_key(rx*w + ry, pawn);
+			}
+		}
+	}
+	assert(hashes[0] == grid.hash);
+	isize count = (w == h) ? 8 : 4;
+	u64 result = hashes[0];
+	for_range(i, 1, count) {
+		result = min(result, hashes[i]);
+	}
+	return result;
+}
+bool operator==(const Grid &a, const Grid &b) {
+	if(a.width != b.width || a.height != b.height || a.hash != b.hash) {
+		return false;
+	}
+	//           memcmp returns 0 if equal
+	return !bool(memcmp(a.data, b.data, a.get_count()*sizeof(Pawn)));
+}
 
 void grid_remove_goals_and_pusher(Grid &grid) {
 	Vector2i tile;
@@ -210,6 +262,19 @@ char pawn_to_char(Pawn pawn) {
 	}
 	return 0;
 }
+// The inverse of pawn_to_char, false for other characters
+bool char_to_pawn(char c, Pawn *pawn) {
+	switch(c) {
+		case '-': *pawn = Pawn::Empty; return true;
+		case 'p': *pawn = Pawn::Pusher; return true;
+		case 'x': *pawn = Pawn::Block; return true;
+		case 'c': *pawn = Pawn::Box; return true;
+		case 'P': *pawn = Pawn::Pusher_On_Goal; return true;
+		case 'C': *pawn = Pawn::Box_On_Goal; return true;
+		case 'g': *pawn = Pawn::Goal; return true;
+	}
+	return false;
+}
 String str(const Grid &grid) {
 	auto arr = make_array<char>(0, grid.get_count() + grid.height + 1);
 	for_range(y, 0, grid.height) {
@@ -220,6 +285,14 @@ String str(const Grid &grid) {
 	}
 	return make_string(arr);
 }
+// Appends the grid in the format of save_level_set (see parse_file_data)
+void write_level(FILE *file, const Grid &grid) {
+	fprintf(file, "LEVEL %d %d\n", grid.width, grid.height);
+	auto s = str(grid);
+	fwrite(s.data, 1, s.count, file);
+	s.destroy();
+	fputs("\n\n", file);
+}
 
 
 std::ostream &operator<<(std::ostream &os, const Grid &grid) {
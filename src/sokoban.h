@@ -48,6 +48,47 @@ enum struct Direction {
 	Down,
 	Left,
 };
+// x*y <= 254 (see print_and_check_settings), so every cell index fits into a u8
+#define MAX_CELL_COUNT 256
+
+/*
+	Zobrist keys: a grid hashes to the xor of the keys of the pawn bits of its cells.
+	Changing a single cell only needs the keys of its old and new pawn (see Grid::set).
+	The keys are generated at compile time, the hashes are the same for every run.
+*/
+struct Zobrist_Keys {
+	u64 goal[MAX_CELL_COUNT];
+	u64 pusher[MAX_CELL_COUNT];
+	u64 box[MAX_CELL_COUNT];
+	u64 block[MAX_CELL_COUNT];
+};
+constexpr u64 splitmix64_next(u64 &state) {
+	state += 0x9e3779b97f4a7c15;
+	u64 z = state;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+	return z ^ (z >> 31);
+}
+constexpr Zobrist_Keys make_zobrist_keys(u64 seed) {
+	Zobrist_Keys keys = {};
+	u64 state = seed;
+	for(isize i = 0; i < MAX_CELL_COUNT; i += 1) keys.goal[i]   = splitmix64_next(state);
+	for(isize i = 0; i < MAX_CELL_COUNT; i += 1) keys.pusher[i] = splitmix64_next(state);
+	for(isize i = 0; i < MAX_CELL_COUNT; i += 1) keys.box[i]    = splitmix64_next(state);
+	for(isize i = 0; i < MAX_CELL_COUNT; i += 1) keys.block[i]  = splitmix64_next(state);
+	return keys;
+}
+inline constexpr Zobrist_Keys ZOBRIST_KEYS = make_zobrist_keys(0x5eed);
+
+inline u64 zobrist_pawn_key(isize index, Pawn pawn) {
+	u8 p = u8(pawn);
+	// every bit of the pawn selects its key with a mask of all ones
+	return (ZOBRIST_KEYS.goal[index]   & (u64(0) - ((p >> 0) & 1)))
+		 ^ (ZOBRIST_KEYS.pusher[index] & (u64(0) - ((p >> 4) & 1)))
+		 ^ (ZOBRIST_KEYS.box[index]    & (u64(0) - ((p >> 5) & 1)))
+		 ^ (ZOBRIST_KEYS.block[index]  & (u64(0) - ((p >> 6) & 1)));
+}
+
 /*
 	Grid/Sokoban Game
 
@@ -65,6 +106,9 @@ struct Grid {
 	Pawn *data;
 	i32 width; // also stride for indexing
 	i32 height;
+	// Zobrist hash of data, kept up to date by set (see grid_hash).
+	// Code that writes data directly has to set it itself.
+	u64 hash;
 	
 	bool pawn_move(i32 x, i32 y, Direction direction);
 	bool pawn_move(i32 x, i32 y, Vector2i direction);
@@ -120,10 +164,12 @@ struct Grid {
 		i32 index = width*y + x;
 		assert(0<=x && x<width && 0<=y && y<height);
 		assert(0<=index && index<get_count());
+		hash ^= zobrist_pawn_key(index, data[index]) ^ zobrist_pawn_key(index, pawn);
 		data[index] = pawn;	
 	}
 	force_inline void set(i32 index, Pawn pawn) {
 		assert(0<=index && index<get_count());
+		hash ^= zobrist_pawn_key(index, data[index]) ^ zobrist_pawn_key(index, pawn);
 		data[index] = pawn;	
 	}
 	
@@ -131,6 +177,7 @@ struct Grid {
 		assert(0<=index && index<get_count());
 		return data[index];	
 	}
+	// Writing through the reference doesn't update the hash, use set for that
 	force_inline Pawn &operator()(i32 x, i32 y) {
 		i32 index = width*y + x;
 		assert(0<=x && x<width && 0<=y && y<height);
@@ -147,10 +194,66 @@ struct Grid {
 };
 
 
+// Set of cell indices of a grid with one bit per cell.
+// Only a view; the words are stored by the owner (see Mcts_Node).
+struct Cell_Set {
+	u64 *words;
+	isize word_count;
+
+	force_inline void add(isize index) {
+		words[index >> 6] |= u64(1) << (index & 63);
+	}
+	force_inline void remove(isize index) {
+		words[index >> 6] &= ~(u64(1) << (index & 63));
+	}
+	force_inline bool has(isize index) const {
+		return (words[index >> 6] >> (index & 63)) & 1;
+	}
+	bool is_empty() const {
+		u64 any = 0;
+		for_range(i, 0, word_count) {
+			any |= words[i];
+		}
+		return any == 0;
+	}
+	isize count() const {
+		isize result = 0;
+		for_range(i, 0, word_count) {
+			result += popcount(words[i]);
+		}
+		return result;
+	}
+	// Returns the n-th smallest index of the set (n < count)
+	isize nth(isize n) const {
+		for_range(i, 0, word_count) {
+			u64 word = words[i];
+			isize word_count = popcount(word);
+			if(n >= word_count) {
+				n -= word_count;
+				continue;
+			}
+			for_range(j, 0, n) {
+				word &= word - 1;
+			}
+			return i*64 + count_trailing_zeros(word);
+		}
+		assert(false);
+		return -1;
+	}
+};
+constexpr isize cell_set_word_count(isize cell_count) {
+	return (cell_count + 63) / 64;
+}
+
 Grid clone_grid(Grid &base);
+bool operator==(const Grid &, const Grid &);
 String str(const Grid &grid);
+void write_level(FILE *, const Grid &);
+bool char_to_pawn(char, Pawn *);
 std::ostream &operator<<(std::ostream &, const Grid &);
 Grid make_grid(i32 width, i32 height);
+u64 grid_hash(const Grid &);
+u64 grid_symmetry_hash(const Grid &);
 void grid_remove_goals_and_pusher(Grid &);
 i32 grid_block_count(Grid &);
 struct Level {
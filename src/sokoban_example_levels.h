@@ -7,92 +7,65 @@
 #include "mcts_actions.h"
 #include "util.h"
 #include "app.h"
+#include "transposition.h"
+#include "level_corpus.h"
 
 void test_mark_goal(Mcts_Node &node, Vector2i box, Vector2i goal) {
 	auto boxi = node.grid.as_index(box.x, box.y);
 	auto goali = node.grid.as_index(goal.x, goal.y);
 	assert(pawn_is_box(node.grid.get(box.x, box.y)));
 	assert(pawn_is_goal(node.grid.get(goal.x, goal.y)));
-	assert(node.second[boxi] == INVALID_INDEX);
-	node.second[boxi] = goali;
-}
-Mcts_Node test_node_ex_1(Grid &grid) {
-	Mcts_Node node;
-	node.box_count = 1;
-	node.grid = grid;
-	node.second = make_array<u8>(25);
-	for_range(i, 0, node.second.count) {
-		node.second[i] = INVALID_INDEX;
-	}
-	test_mark_goal(node, {3,2}, {3,4});
-	node.flags |= MCTS_TERMINAL;
-	node.pusher = grid.as_index(grid.get_pusher_position());
+	assert(node.second_table()[boxi] == INVALID_INDEX);
+	node.second_table()[boxi] = goali;
+}
+// Terminal node with a copy of the grid whose goals are marked with test_mark_goal
+Mcts_Node *new_test_node(Grid &grid, i16 box_count) {
+	auto node = new_mcts_node(grid.width, grid.height, true);
+	memcpy(node->grid.data, grid.data, grid.get_count());
+	node->grid.hash = grid.hash;
+	memset(node->second_table(), INVALID_INDEX, grid.get_count());
+	node->box_count = box_count;
+	node->flags |= MCTS_TERMINAL;
+	node->pusher = grid.as_index(grid.get_pusher_position());
+	return node;
+}
+Mcts_Node *test_node_ex_1(Grid &grid) {
+	Mcts_Node *node = new_test_node(grid, 1);
+	test_mark_goal(*node, {3,2}, {3,4});
 	return node;
 }
-Mcts_Node test_node_ex_2(Grid &grid) {
-	Mcts_Node node;
-	node.box_count = 3;
-	node.grid = grid;
-	node.second = make_array<u8>(25);
-	for_range(i, 0, node.second.count) {
-		node.second[i] = INVALID_INDEX;
-	}
-	test_mark_goal(node, {1,2}, {0,1});
-	test_mark_goal(node, {3,2}, {4,3});
-	test_mark_goal(node, {2,3}, {4,2});
-	node.flags |= MCTS_TERMINAL;
-	node.pusher = grid.as_index(grid.get_pusher_position());
+Mcts_Node *test_node_ex_2(Grid &grid) {
+	Mcts_Node *node = new_test_node(grid, 3);
+	test_mark_goal(*node, {1,2}, {0,1});
+	test_mark_goal(*node, {3,2}, {4,3});
+	test_mark_goal(*node, {2,3}, {4,2});
 	return node;
 }
-Mcts_Node test_node_ex_3(Grid &grid) {
-	Mcts_Node node;
-	node.box_count = 4;
-	node.grid = grid;
-	node.second = make_array<u8>(25);
-	for_range(i, 0, node.second.count) {
-		node.second[i] = INVALID_INDEX;
-	}
-	test_mark_goal(node, {1,0}, {3,0});
-	test_mark_goal(node, {2,1}, {2,4});
-	test_mark_goal(node, {1,2}, {0,4});
-	test_mark_goal(node, {1,3}, {0,3});
-	node.flags |= MCTS_TERMINAL;
-	node.pusher = grid.as_index(grid.get_pusher_position());
+Mcts_Node *test_node_ex_3(Grid &grid) {
+	Mcts_Node *node = new_test_node(grid, 4);
+	test_mark_goal(*node, {1,0}, {3,0});
+	test_mark_goal(*node, {2,1}, {2,4});
+	test_mark_goal(*node, {1,2}, {0,4});
+	test_mark_goal(*node, {1,3}, {0,3});
 	return node;
 }
-Mcts_Node test_node_ex_4(Grid &grid) {
-	Mcts_Node node;
-	node.box_count = 5;
-	node.grid = grid;
-	node.second = make_array<u8>(25);
-	for_range(i, 0, node.second.count) {
-		node.second[i] = INVALID_INDEX;
-	}
-	test_mark_goal(node, {1,1}, {0,0});
-	test_mark_goal(node, {2,1}, {1,0});
-	test_mark_goal(node, {1,2}, {1,4});
-	test_mark_goal(node, {3,2}, {3,0});
-	test_mark_goal(node, {2,3}, {4,3});
-	node.flags |= MCTS_TERMINAL;
-	node.pusher = grid.as_index(grid.get_pusher_position());
+Mcts_Node *test_node_ex_4(Grid &grid) {
+	Mcts_Node *node = new_test_node(grid, 5);
+	test_mark_goal(*node, {1,1}, {0,0});
+	test_mark_goal(*node, {2,1}, {1,0});
+	test_mark_goal(*node, {1,2}, {1,4});
+	test_mark_goal(*node, {3,2}, {3,0});
+	test_mark_goal(*node, {2,3}, {4,3});
 	return node;
 }
-Mcts_Node test_node_ex_5(Grid &grid) {
-	Mcts_Node node;
-	node.box_count = 6;
-	node.grid = grid;
-	node.second = make_array<u8>(25);
-	for_range(i, 0, node.second.count) {
-		node.second[i] = INVALID_INDEX;
-	}
-	test_mark_goal(node, {0,1}, {0,3});
-	test_mark_goal(node, {1,1}, {1,3});
-	test_mark_goal(node, {2,1}, {3,0});
-	test_mark_goal(node, {1,2}, {4,2});
-	test_mark_goal(node, {3,2}, {4,1});
-	test_mark_goal(node, {2,3}, {4,3});
-	node.flags |= MCTS_TERMINAL;
-	node.pusher = grid.as_index(grid.get_pusher_position());
+Mcts_Node *test_node_ex_5(Grid &grid) {
+	Mcts_Node *node = new_test_node(grid, 6);
+	test_mark_goal(*node, {0,1}, {0,3});
+	test_mark_goal(*node, {1,1}, {1,3});
+	test_mark_goal(*node, {2,1}, {3,0});
+	test_mark_goal(*node, {1,2}, {4,2});
+	test_mark_goal(*node, {3,2}, {4,1});
+	test_mark_goal(*node, {2,3}, {4,3});
 	return node;
 }
 void make_test_level_set(Game &game) {
@@ -113,38 +86,38 @@ void make_test_level_set(Game &game) {
 	mcts.start_position_tile = {2,2};
 	mcts.area = 5*5;
 	mcts.score_scale = get_score_scale(&mcts);
-	println(score_node(ex_node_1, &mcts), "~= 0.4");
-	println(score_node(ex_node_2, &mcts), "~= 0.6");
-	println(score_node(ex_node_3, &mcts), "~= 0.8");
-	println(score_node(ex_node_4, &mcts), "~= 1.0");
-	println(score_node(ex_node_5, &mcts), "~= 1.2");
+	mcts.shape = make_board_shape(5, 5);
+	println(score_node(*ex_node_1, &mcts), "~= 0.4");
+	println(score_node(*ex_node_2, &mcts), "~= 0.6");
+	println(score_node(*ex_node_3, &mcts), "~= 0.8");
+	println(score_node(*ex_node_4, &mcts), "~= 1.0");
+	println(score_node(*ex_node_5, &mcts), "~= 1.2");
+	Array<Move_Info> moves = {};
 	{
-		auto &node = ex_node_1;
-		auto moves = get_all_possible_moves(node.grid.as_tile(node.pusher), node.grid);
+		auto &node = *ex_node_1;
+		get_all_possible_moves(node.grid.as_tile(node.pusher), node.grid, mcts.shape, moves);
 
 		/* print_2d(visited, 5, 5);
 		print_move_infos(moves, node.grid); */
-		moves.destroy();
 		println("----------------------");
 	}
 	{
-		auto &node = ex_node_2;
-		auto moves = get_all_possible_moves(node.grid.as_tile(node.pusher), node.grid);
+		auto &node = *ex_node_2;
+		get_all_possible_moves(node.grid.as_tile(node.pusher), node.grid, mcts.shape, moves);
 
 		/* print_2d(visited, 5, 5);
 		print_move_infos(moves, node.grid); */
-		moves.destroy();
 		println("----------------------");
 	}
 	{
-		auto &node = ex_node_3;
-		auto moves = get_all_possible_moves(node.grid.as_tile(node.pusher), node.grid);
+		auto &node = *ex_node_3;
+		get_all_possible_moves(node.grid.as_tile(node.pusher), node.grid, mcts.shape, moves);
 
 		/* print_2d(visited, 5, 5);
 		print_move_infos(moves, node.grid); */
-		moves.destroy();
 		println("----------------------");
 	}
+	moves.destroy();
 }
 struct Data_Set_Struct {
 	f64 wb;
@@ -184,11 +157,11 @@ void test_level_set_derive_values(Game &game) {
 	for_range(wbi, 1, 20) for_range(wci, 1, 20) for_range(wni, 1, 20) {
 		f64 wb = wstep * (f64)wbi, wc = wstep * (f64)wci, wn = wstep * (f64)wni;
 		f64 alpha = step * f64(ai), beta = step * f64(bi), gamma = step * f64(ci);
-		auto a = score_node_test(ex_node_1, &mcts, wb, wc, wn, k, alpha, beta, gamma);
-		auto b = score_node_test(ex_node_2, &mcts, wb, wc, wn, k, alpha, beta, gamma);
-		auto c = score_node_test(ex_node_3, &mcts, wb, wc, wn, k, alpha, beta, gamma);
-		auto d = score_node_test(ex_node_4, &mcts, wb, wc, wn, k, alpha, beta, gamma);
-		auto e = score_node_test(ex_node_5, &mcts, wb, wc, wn, k, alpha, beta, gamma);
+		auto a = score_node_test(*ex_node_1, &mcts, wb, wc, wn, k, alpha, beta, gamma);
+		auto b = score_node_test(*ex_node_2, &mcts, wb, wc, wn, k, alpha, beta, gamma);
+		auto c = score_node_test(*ex_node_3, &mcts, wb, wc, wn, k, alpha, beta, gamma);
+		auto d = score_node_test(*ex_node_4, &mcts, wb, wc, wn, k, alpha, beta, gamma);
+		auto e = score_node_test(*ex_node_5, &mcts, wb, wc, wn, k, alpha, beta, gamma);
 		if(a<b && b<c && c<d && d<e) {
 			const auto av = abs(0.4-a);
 			const auto bv = abs(0.6-b);
@@ -205,11 +178,395 @@ void test_level_set_derive_values(Game &game) {
 		}
 	}
 	println(set.wb, set.wc, set.wn, set.alpha, set.beta, set.gamma);	
-	println(score_node_test(ex_node_1, &mcts, set.wb, set.wc, set.wn, k, set.alpha, set.beta, set.gamma), "~= 0.4");
-	println(score_node_test(ex_node_2, &mcts, set.wb, set.wc, set.wn, k, set.alpha, set.beta, set.gamma), "~= 0.6");
-	println(score_node_test(ex_node_3, &mcts, set.wb, set.wc, set.wn, k, set.alpha, set.beta, set.gamma), "~= 0.8");
-	println(score_node_test(ex_node_4, &mcts, set.wb, set.wc, set.wn, k, set.alpha, set.beta, set.gamma), "~= 1.0");
-	println(score_node_test(ex_node_5, &mcts, set.wb, set.wc, set.wn, k, set.alpha, set.beta, set.gamma), "~= 1.2");
+	println(score_node_test(*ex_node_1, &mcts, set.wb, set.wc, set.wn, k, set.alpha, set.beta, set.gamma), "~= 0.4");
+	println(score_node_test(*ex_node_2, &mcts, set.wb, set.wc, set.wn, k, set.alpha, set.beta, set.gamma), "~= 0.6");
+	println(score_node_test(*ex_node_3, &mcts, set.wb, set.wc, set.wn, k, set.alpha, set.beta, set.gamma), "~= 0.8");
+	println(score_node_test(*ex_node_4, &mcts, set.wb, set.wc, set.wn, k, set.alpha, set.beta, set.gamma), "~= 1.0");
+	println(score_node_test(*ex_node_5, &mcts, set.wb, set.wc, set.wn, k, set.alpha, set.beta, set.gamma), "~= 1.2");
+}
+
+// area_score_of_v2_simd has to match the scalar version exactly
+void test_area_score_simd(isize grid_count) {
+	const Pawn pawns[] = {Pawn::Empty, Pawn::Block, Pawn::Block, Pawn::Box, Pawn::Goal, Pawn::Box_On_Goal, Pawn::Pusher};
+	for_range(i, 0, grid_count) {
+		i32 width = randi_range(1, 16);
+		i32 height = randi_range(1, min(16, MAX_CELL_COUNT/width - 1));
+		Grid grid = make_grid(width, height);
+		// mostly blocks or mostly empty grids as well
+		i32 block_bias = randi_range(0, 2);
+		for_range(j, 0, grid.get_count()) {
+			Pawn pawn = pawns[randi_range(0, carray_len(pawns)-1)];
+			if(block_bias == 1 && randi_range(0, 3) > 0) pawn = Pawn::Block;
+			if(block_bias == 2 && randi_range(0, 3) > 0) pawn = Pawn::Empty;
+			grid.set(j, pawn);
+		}
+		i32 a = area_score_of_v2(grid);
+		i32 b = area_score_of_v2_simd(grid);
+		if(a != b) {
+			println(str(grid));
+			println(a, b);
+			release_assert(false);
+		}
+		grid.destroy();
+	}
+	println("area score simd ok:", grid_count);
+}
+
+// The hash which Grid::set updates has to match the full computation after every kind of change
+void test_grid_hash(isize grid_count) {
+	const Pawn pawns[] = {Pawn::Empty, Pawn::Block, Pawn::Box, Pawn::Goal, Pawn::Box_On_Goal, Pawn::Pusher, Pawn::Pusher_On_Goal};
+	auto check = [](Grid &grid, const char *msg) {
+		if(grid.hash != grid_hash(grid)) {
+			println(str(grid));
+			println(msg);
+			release_assert(false);
+		}
+	};
+	for_range(i, 0, grid_count) {
+		i32 width = randi_range(1, 16);
+		i32 height = randi_range(1, min(16, MAX_CELL_COUNT/width - 1));
+		Grid grid = make_grid(width, height);
+		check(grid, "make_grid");
+		for_range(j, 0, grid.get_count()) {
+			grid.set(j, pawns[randi_range(0, carray_len(pawns)-1)]);
+		}
+		check(grid, "set");
+		for_range(j, 0, 4*grid.get_count()) {
+			i32 a = randi_range(0, grid.get_count()-1);
+			i32 b = randi_range(0, grid.get_count()-1);
+			switch(randi_range(0, 2)) {
+			case 0:
+				grid.set(a, pawns[randi_range(0, carray_len(pawns)-1)]);
+				break;
+			case 1:
+				grid.swap_top_layer(a, b);
+				break;
+			case 2: {
+				// pawn_move expects a pusher which doesn't run into another one or a block on a goal
+				auto has = [&](Vector2i v, Pawn pawn) {
+					return grid.in_grid(v.x, v.y) && (u8(grid.get(v)) & u8(pawn));
+				};
+				auto tile = grid.as_tile(a);
+				Vector2i d = DIRECTION_TO_VEC[randi_range(0, 3)];
+				if(has(tile, Pawn::Pusher) && !has(tile + d, Pawn::Pusher) && !has(tile + d, Pawn::Block) && !has(tile + 2*d, Pawn::Pusher)) {
+					grid.pawn_move(tile.x, tile.y, d);
+				}
+			} break;
+			}
+			check(grid, "set/swap_top_layer/pawn_move");
+		}
+		Grid clone = clone_grid(grid);
+		release_assert(clone == grid && clone.hash == grid.hash);
+		grid_remove_goals_and_pusher(clone);
+		check(clone, "grid_remove_goals_and_pusher");
+
+		// the bitboards hash the same way
+		Bitboard board = make_bitboard(grid);
+		release_assert(bitboard_hash(board) == grid.hash);
+		bitboard_to_grid(board, clone);
+		check(clone, "bitboard_to_grid");
+		release_assert(clone == grid);
+
+		// rotations and reflections have the same symmetry hash
+		Grid mirror = make_grid(width, height);
+		Grid turn = make_grid(height, width);
+		for_range(y, 0, height) {
+			for_range(x, 0, width) {
+				Pawn pawn = grid.get(x, y);
+				mirror.set(width-1 - x, y, pawn);
+				turn.set(height-1 - y, x, pawn);
+			}
+		}
+		check(mirror, "mirror");
+		release_assert(grid_symmetry_hash(mirror) == grid_symmetry_hash(grid));
+		if(width == height) {
+			release_assert(grid_symmetry_hash(turn) == grid_symmetry_hash(grid));
+		}
+		
+		turn.destroy();
+		mirror.destroy();
+		clone.destroy();
+		grid.destroy();
+	}
+	println("grid hash ok:", grid_count);
+}
+
+// Selection micro-benchmark: best_child with the node_* function called through a pointer for every child
+// against the policy types (see with_decision_policy) on a parent with child_count children.
+// Both have to select the same child.
+void benchmark_best_child(isize child_count, isize iterations) {
+	auto parent = new_mcts_node(7, 7, false);
+	for_range(i, 0, child_count) {
+		auto child = new_mcts_node(7, 7, false);
+		child->parent = parent;
+		child->rollout_count = randi_range(1, 1000);
+		child->score_sum = child->rollout_count * randf_range(0.0, 1.5);
+		child->squared_score_sum = child->score_sum * randf_range(0.0, 1.5);
+		parent->rollout_count += child->rollout_count;
+		parent->children.add(child);
+		add_child_stats(parent);
+	}
+	// changes the statistics of a child and its slot
+	auto set_stats = [&](Mcts_Node *it, i32 count, f64 score, f64 squared) {
+		it->score_sum = 0;
+		it->squared_score_sum = 0;
+		it->rollout_count = 0;
+		parent->child_stats.set(it->child_index, 0, 0, 0);
+		add_node_stats(it, score, squared, count);
+	};
+	// volatile so the compiler doesn't know which procedure gets called through the pointer
+	Decision_Proc volatile procs[] = {node_ucb1, node_ucb1_tuned, node_ucb_v, node_sp_mcts};
+	const char *names[] = {"ucb1", "ucb1-tuned", "ucb-v", "sp-mcts"};
+	isize sum = 0;
+	for_range(k, 0, (isize)carray_len(procs)) {
+		Decision_Proc proc = procs[k];
+		with_decision_policy(proc, [&](auto policy) {
+			for_range(i, 0, 1000) {
+				// unvisited children and children with a single rollout as well
+				auto it = parent->children[randi_range(0, child_count-1)];
+				i32 count = randi_range(0, 2);
+				f64 score = count * randf_range(0.0, 1.5);
+				set_stats(it, count, score, score * randf_range(0.0, 1.5));
+				release_assert(best_child(parent, nullptr, policy) == best_child(parent, nullptr, Decision_Proc_Policy{proc}));
+				count = randi_range(1, 1000);
+				score = count * randf_range(0.0, 1.5);
+				set_stats(it, count, score, score * randf_range(0.0, 1.5));
+			}
+		});
+		auto point_start = get_time();
+		for_range(i, 0, iterations) {
+			// changes the result of the log every time
+			parent->rollout_count += 1;
+			sum += (isize)best_child(parent, nullptr, Decision_Proc_Policy{proc});
+		}
+		f64 pointer_time = time_diff(point_start, get_time());
+		point_start = get_time();
+		with_decision_policy(proc, [&](auto policy) {
+			for_range(i, 0, iterations) {
+				parent->rollout_count += 1;
+				sum += (isize)best_child(parent, nullptr, policy);
+			}
+		});
+		f64 policy_time = time_diff(point_start, get_time());
+		f64 to_ns = 1e9/f64(iterations*child_count);
+		println(names[k], "ns per child | pointer:", pointer_time*to_ns, "policy:", policy_time*to_ns, "speedup:", pointer_time/policy_time);
+	}
+	println("(", sum & 1, ")");
+	parent->destroy();
+	mem_free(parent);
+}
+
+// Descent micro-benchmark: grows trees to the given rollout counts and times the selection from the root
+// to a node that can still be expanded followed by the backup of a random score,
+// i.e. uct_body without the expansion and the default_policy.
+// In the search the default_policy runs in between and evicts the tree from the caches,
+// the cold descents do that with a buffer bigger than the L2 cache (not timed).
+void benchmark_descent(isize iterations, isize cold_iterations) {
+	i64 sizes[] = {1000, 10000, 100000, 400000};
+	Array<u8> evict = make_array<u8>(8*1024*1024);
+	init_data(evict, u8(0));
+	for(auto size: sizes) {
+		auto mcts = new_mcts(1234, default_mcts_config());
+		mcts->quiet = true;
+		mcts->start();
+		for_range(i, 0, size) {
+			mcts->next_rollout(node_ucb1_tuned);
+		}
+		Tree_Path path;
+		// returns the number of selected children
+		auto descend = [&]() {
+			isize step_count = 0;
+			auto node = mcts->root;
+			isize slot = -1;
+			path.count = 0;
+			while(true) {
+				if(!(node->flags & MCTS_SECOND_ACTION)) {
+					path.add(node, slot);
+				}
+				if((node->flags & MCTS_TERMINAL) || !is_bloomed(node) || node->can_expand() || node->children.count == 0) {
+					break;
+				}
+				slot = best_child_index(node, mcts, Ucb1_Tuned_Policy{});
+				node = node->children[slot];
+				step_count += 1;
+			}
+			f64 score = randf_range(0.0, 1.0);
+			if(mcts->transpositions) {
+				add_score_and_propagate_path(node, path, score);
+			} else {
+				node->add_score_and_propagate(score);
+			}
+			return step_count;
+		};
+		isize step_count = 0;
+		auto point_start = get_time();
+		for_range(i, 0, iterations) {
+			step_count += descend();
+		}
+		f64 duration = time_diff(point_start, get_time());
+
+		f64 cold_duration = 0;
+		for_range(i, 0, cold_iterations) {
+			for(isize j = 0; j < evict.count; j += 64) {
+				evict[j] += 1;
+			}
+			point_start = get_time();
+			descend();
+			cold_duration += time_diff(point_start, get_time());
+		}
+		println("rollouts:", size, "| levels per descent:", f64(step_count)/f64(iterations),
+			"| ns per descent:", duration*1e9/f64(iterations), "| cold:", cold_duration*1e9/f64(cold_iterations));
+		delete_mcts(mcts);
+	}
+	evict.destroy();
+}
+
+// Random levels of every size up to MAX_CELL_COUNT through a corpus, its conversion to text and back.
+// Prints the time of the writes and of reading the levels by id in random order.
+void test_level_corpus(isize level_count, const char *path) {
+	const Pawn pawns[] = {Pawn::Empty, Pawn::Block, Pawn::Box, Pawn::Goal, Pawn::Box_On_Goal, Pawn::Pusher, Pawn::Pusher_On_Goal};
+	const char *text_path = "saved_levels/test_level_corpus.txt";
+	const char *copy_path = "saved_levels/test_level_corpus_copy.corpus";
+	remove(path);
+	remove(copy_path);
+	auto levels = make_array<Level>(level_count);
+	Corpus_Writer writer;
+	release_assert(open_corpus_writer(&writer, path));
+	auto point_start = get_time();
+	for_range(i, 0, level_count) {
+		i32 width = randi_range(1, 16);
+		i32 height = randi_range(1, min(255, MAX_CELL_COUNT/width));
+		Grid grid = make_grid(width, height);
+		for_range(j, 0, grid.get_count()) {
+			grid.set(j, pawns[randi_range(0, carray_len(pawns)-1)]);
+		}
+		Level level = {};
+		level.grid = grid;
+		level.box_count = i32(randi_range(0, 100));
+		level.score = f32(randf_range(0, 2));
+		levels[i] = level;
+		release_assert(writer.append(grid, levels[i].box_count, levels[i].score, u64(i) * 0x9e3779b97f4a7c15));
+		// a reader only sees the flushed levels
+		if(i == level_count/2) {
+			release_assert(writer.flush());
+			Level_Corpus corpus;
+			release_assert(open_level_corpus(&corpus, path) && corpus.count == i + 1);
+			close_level_corpus(&corpus);
+		}
+	}
+	release_assert(close_corpus_writer(&writer));
+	f64 write_time = time_diff(point_start, get_time());
+
+	Level_Corpus corpus;
+	release_assert(open_level_corpus(&corpus, path) && corpus.count == level_count);
+	point_start = get_time();
+	for_range(k, 0, level_count) {
+		i64 i = randi_range(0, level_count-1);
+		Level level = corpus.get(i);
+		auto &expected = levels[i];
+		release_assert(level.grid == expected.grid && level.grid.hash == expected.grid.hash, "corpus grid differs");
+		release_assert(level.box_count == expected.box_count && level.score == expected.score, "corpus level differs");
+		release_assert(corpus.record(i).seed == u64(i) * 0x9e3779b97f4a7c15);
+		level.grid.destroy();
+	}
+	f64 read_time = time_diff(point_start, get_time());
+	close_level_corpus(&corpus);
+
+	// the text has the grids only
+	release_assert(convert_corpus_to_text(path, text_path) == level_count);
+	release_assert(convert_text_to_corpus(text_path, copy_path) == level_count);
+	release_assert(open_level_corpus(&corpus, copy_path) && corpus.count == level_count);
+	for_range(i, 0, level_count) {
+		Grid grid = corpus_record_grid(corpus.record(i));
+		release_assert(grid == levels[i].grid, "converted grid differs");
+		grid.destroy();
+	}
+	close_level_corpus(&corpus);
+
+	for_range(i, 0, level_count) {
+		levels[i].grid.destroy();
+	}
+	levels.destroy();
+	remove(path);
+	remove(text_path);
+	remove(copy_path);
+	println("level corpus ok:", level_count, "| write s:", write_time, "| random reads s:", read_time);
+}
+
+// The statistics of every node (each shared one once) and the finished levels, see test_checkpoint
+struct Tree_Summary {
+	i64 node_count = 0;
+	i64 rollout_count = 0;
+	f64 score_sum = 0;
+	i64 level_count = 0;
+	f64 level_score_sum = 0;
+	f64 best_score = 0;
+	bool operator==(const Tree_Summary &o) const {
+		return node_count == o.node_count && rollout_count == o.rollout_count && score_sum == o.score_sum
+			&& level_count == o.level_count && level_score_sum == o.level_score_sum && best_score == o.best_score;
+	}
+};
+Tree_Summary summarize_tree(Mcts *mcts) {
+	Tree_Summary s;
+	Hash_Set visited = {};
+	auto stack = make_array<Mcts_Node *>(0, 256);
+	stack.add(mcts->root);
+	while(stack.count > 0) {
+		Mcts_Node *node = stack[stack.count - 1];
+		stack.count -= 1;
+		if(!visited.add(u64(uintptr_t(node)))) continue;
+		s.node_count += 1;
+		s.rollout_count += node->rollout_count;
+		s.score_sum += node->score_sum;
+		for_range(i, 0, node->children.count) {
+			stack.add(node->children[i]);
+		}
+	}
+	for_range(i, 0, mcts->finished_nodes.count) {
+		s.level_score_sum += mcts->finished_nodes[i].score;
+	}
+	s.level_count = mcts->finished_nodes.count;
+	s.best_score = mcts->best_score;
+	stack.destroy();
+	visited.destroy();
+	return s;
+}
+// A search that is saved after rollout_count rollouts and loaded again has to go on exactly like
+// the one it has been saved from. Prints the time of the save and the load.
+void test_checkpoint(i64 rollout_count, const char *path) {
+	auto config = default_mcts_config();
+	auto mcts = new_mcts(1234, config);
+	mcts->quiet = true;
+	mcts->start();
+	for_range(i, 0, rollout_count) {
+		mcts->next_rollout(node_ucb1_tuned);
+	}
+	auto saved = summarize_tree(mcts);
+	auto point_start = get_time();
+	release_assert(save_mcts_checkpoint(mcts, path));
+	f64 save_time = time_diff(point_start, get_time());
+	// the rest of the search without the checkpoint, it continues with the random engines of the save
+	for_range(i, 0, rollout_count/2) {
+		mcts->next_rollout(node_ucb1_tuned);
+	}
+	auto continued = summarize_tree(mcts);
+	isize memory_size = tree_memory_size(mcts);
+	delete_mcts(mcts);
+
+	point_start = get_time();
+	auto loaded = load_mcts_checkpoint(path);
+	f64 load_time = time_diff(point_start, get_time());
+	release_assert(loaded);
+	release_assert(summarize_tree(loaded) == saved, "loaded tree differs");
+	loaded->quiet = true;
+	loaded->start();
+	for_range(i, 0, rollout_count/2) {
+		loaded->next_rollout(node_ucb1_tuned);
+	}
+	release_assert(summarize_tree(loaded) == continued, "continued search differs");
+	delete_mcts(loaded);
+	remove(path);
+	println("checkpoint ok | nodes:", saved.node_count, "| MB:", f64(memory_size)/1e6, "| save s:", save_time, "| load s:", load_time);
 }
 
 
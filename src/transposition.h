@@ -0,0 +1,61 @@
+#ifndef TRANSPOSITION_H
+#define TRANSPOSITION_H
+
+#include "mcts.h"
+
+// Full computation of the hash of a first phase board (see Grid::hash).
+// Delete obstacle and place box update the hash of a child with a single xor instead.
+inline u64 zobrist_hash(Mcts_Node &node) {
+    assert(!(node.flags & MCTS_SECOND_ACTION));
+    Bitboard board = {};
+    board.block = load_bits(node.block_set());
+    board.box = load_bits(node.box_set());
+    return bitboard_hash(board);
+}
+
+/*
+    First phase nodes of a tree by their board (open addressing with linear probing).
+    Only pointers are stored, the hash is part of the node (grid.hash).
+    The table grows at half load and uses its own allocator since the pool can't give back big blocks.
+*/
+struct Transposition_Table {
+    Mcts_Node **nodes = nullptr;
+    isize capacity = 0; // power of 2
+    isize count = 0;
+    Allocator *allocator = nullptr; // the underlying allocator (malloc)
+
+    // node with the same board as the given one or nullptr
+    Mcts_Node *find(Mcts_Node *);
+    // the board of the node must not be in the table
+    void add(Mcts_Node *);
+    // the node must be in the table
+    void remove(Mcts_Node *);
+    void grow();
+    // capacity is a power of 2 with room for count
+    void resize(isize capacity);
+    void destroy();
+};
+Transposition_Table make_transposition_table(Allocator *, isize = 1024);
+
+// Every first phase action removes a block or adds a box, so a rollout passes through at most
+// 2*MAX_CELL_COUNT first phase nodes (+ the roots when bootstrapping).
+#define MAX_FIRST_PHASE_PATH (2*MAX_CELL_COUNT + 2)
+
+// The first phase nodes a rollout went through from the root on.
+// A shared node only knows the parent it was created from, therefore the backup follows this instead.
+struct Tree_Path {
+    Mcts_Node *nodes[MAX_FIRST_PHASE_PATH];
+    // index of nodes[i] in the children (and child_stats) of nodes[i-1], -1 for the first one
+    i32 slots[MAX_FIRST_PHASE_PATH];
+    isize count = 0;
+
+    force_inline void add(Mcts_Node *node, isize slot) {
+        assert(count < MAX_FIRST_PHASE_PATH);
+        assert((count == 0) == (slot < 0));
+        nodes[count] = node;
+        slots[count] = i32(slot);
+        count += 1;
+    }
+};
+
+#endif // TRANSPOSITION_H
@@ -3,10 +3,18 @@
 
 #include "mcts.h"
 
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
 /*
     Following we have the different ucb implementations which are being used
     in tree_policy. 
     node_* is the function which can be passed as a function pointer.
+    The node_* functions read the statistics atomically since the tree can be shared (see mcts_parallel.cpp).
+    They take the parent the rollout came from since a node can have more than one (see mcts_transposition.cpp).
     Reference Decision_Proc and next_rollout/uct_body.
     Usage: decision_proc in main.
 */
@@ -26,8 +34,8 @@ inline f64 ucb1(f64 score, i64 itotal_n, i64 ilocal_n, const f64 C = 1.0/SQRT2)
 
     return avrg + right;
 }
-inline f64 node_ucb1(Mcts_Node *node) {
-    auto u = ucb1(node->score_sum, node->parent->rollout_count, node->rollout_count, UCB1_C);
+inline f64 node_ucb1(Mcts_Node *parent, Mcts_Node *node) {
+    auto u = ucb1(atomic_load(&node->score_sum), atomic_load(&parent->rollout_count), atomic_load(&node->rollout_count), UCB1_C);
     return u;
 }
 /*
@@ -58,8 +66,8 @@ inline f64 ucb1_tuned(f64 score, f64 squared_score, i64 itotal_n, i64 ilocal_n)
     const f64 C = 2.0 * 4.0 * 1.0/SQRT2;
     return avrg + C * right;
 }
-inline f64 node_ucb1_tuned(Mcts_Node *node) {
-    auto u = ucb1_tuned(node->score_sum, node->squared_score_sum, node->parent->rollout_count, node->rollout_count);
+inline f64 node_ucb1_tuned(Mcts_Node *parent, Mcts_Node *node) {
+    auto u = ucb1_tuned(atomic_load(&node->score_sum), atomic_load(&node->squared_score_sum), atomic_load(&parent->rollout_count), atomic_load(&node->rollout_count));
     return u;
 }
 
@@ -104,8 +112,8 @@ inline f64 ucb_v(f64 score, f64 squared_score, i64 itotal_n, i64 ilocal_n) {
     return avrg + left + right;
 }
 
-inline f64 node_ucb_v(Mcts_Node *node) {
-    auto u = ucb_v(node->score_sum, node->squared_score_sum, node->parent->rollout_count, node->rollout_count);
+inline f64 node_ucb_v(Mcts_Node *parent, Mcts_Node *node) {
+    auto u = ucb_v(atomic_load(&node->score_sum), atomic_load(&node->squared_score_sum), atomic_load(&parent->rollout_count), atomic_load(&node->rollout_count));
     return u;
 }
 
@@ -133,11 +141,194 @@ inline f64 sp_mcts(f64 score, f64 squared_score, i64 itotal_n, i64 ilocal_n) {
     f64 possible_deviation = sqrt(variance + SP_MCTS_D/local_n);
     return _ucb1 + possible_deviation;
 }
-inline f64 node_sp_mcts(Mcts_Node *node) {
-    auto u = sp_mcts(node->score_sum, node->squared_score_sum, node->parent->rollout_count, node->rollout_count);
+inline f64 node_sp_mcts(Mcts_Node *parent, Mcts_Node *node) {
+    auto u = sp_mcts(atomic_load(&node->score_sum), atomic_load(&node->squared_score_sum), atomic_load(&parent->rollout_count), atomic_load(&node->rollout_count));
     return u;
 }
 
+// Decision_Proc of Mcts_Config::decision
+inline Decision_Proc get_decision_proc(Decision_Kind kind) {
+    switch(kind) {
+        case Decision_Kind::Ucb1: return node_ucb1;
+        case Decision_Kind::Ucb1_Tuned: return node_ucb1_tuned;
+        case Decision_Kind::Ucb_V: return node_ucb_v;
+        case Decision_Kind::Sp_Mcts: return node_sp_mcts;
+    }
+    crash("unknown decision kind");
+    return nullptr;
+}
+
+/*
+    Lanes of doubles for evaluating the policies of several children at once (see best_child).
+    The formulas of the policies are templates which are used with F64x and with a single f64,
+    both do the same IEEE operations in the same order so the values are identical to node_*.
+*/
+#if defined(__AVX__)
+#define F64X_LANES 4
+struct F64x {
+    __m256d v;
+    F64x() = default;
+    force_inline F64x(__m256d v) : v(v) {}
+    force_inline explicit F64x(f64 x) : v(_mm256_set1_pd(x)) {}
+    static force_inline F64x load(const f64 *p) { return _mm256_loadu_pd(p); }
+    static force_inline F64x load(const i32 *p) { return _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *)p)); }
+    force_inline void store(f64 *p) const { _mm256_storeu_pd(p, v); }
+};
+inline F64x operator+(F64x a, F64x b) { return _mm256_add_pd(a.v, b.v); }
+inline F64x operator-(F64x a, F64x b) { return _mm256_sub_pd(a.v, b.v); }
+inline F64x operator*(F64x a, F64x b) { return _mm256_mul_pd(a.v, b.v); }
+inline F64x operator/(F64x a, F64x b) { return _mm256_div_pd(a.v, b.v); }
+// all bits set where true
+inline F64x operator==(F64x a, F64x b) { return _mm256_cmp_pd(a.v, b.v, _CMP_EQ_OQ); }
+inline F64x operator>(F64x a, F64x b) { return _mm256_cmp_pd(a.v, b.v, _CMP_GT_OQ); }
+inline F64x lanes_sqrt(F64x a) { return _mm256_sqrt_pd(a.v); }
+inline F64x lanes_min(F64x a, F64x b) { return _mm256_min_pd(a.v, b.v); }
+inline F64x lanes_select(F64x mask, F64x a, F64x b) { return _mm256_blendv_pd(b.v, a.v, mask.v); }
+#elif defined(__SSE2__) || defined(_M_X64)
+#define F64X_LANES 2
+struct F64x {
+    __m128d v;
+    F64x() = default;
+    force_inline F64x(__m128d v) : v(v) {}
+    force_inline explicit F64x(f64 x) : v(_mm_set1_pd(x)) {}
+    static force_inline F64x load(const f64 *p) { return _mm_loadu_pd(p); }
+    static force_inline F64x load(const i32 *p) { return _mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i *)p)); }
+    force_inline void store(f64 *p) const { _mm_storeu_pd(p, v); }
+};
+inline F64x operator+(F64x a, F64x b) { return _mm_add_pd(a.v, b.v); }
+inline F64x operator-(F64x a, F64x b) { return _mm_sub_pd(a.v, b.v); }
+inline F64x operator*(F64x a, F64x b) { return _mm_mul_pd(a.v, b.v); }
+inline F64x operator/(F64x a, F64x b) { return _mm_div_pd(a.v, b.v); }
+inline F64x operator==(F64x a, F64x b) { return _mm_cmpeq_pd(a.v, b.v); }
+inline F64x operator>(F64x a, F64x b) { return _mm_cmpgt_pd(a.v, b.v); }
+inline F64x lanes_sqrt(F64x a) { return _mm_sqrt_pd(a.v); }
+inline F64x lanes_min(F64x a, F64x b) { return _mm_min_pd(a.v, b.v); }
+// no blendv without SSE4.1
+inline F64x lanes_select(F64x mask, F64x a, F64x b) { return _mm_or_pd(_mm_and_pd(mask.v, a.v), _mm_andnot_pd(mask.v, b.v)); }
+#endif
+inline f64 lanes_sqrt(f64 a) { return sqrt(a); }
+// same as min and _mm_min_pd: a if a < b else b
+inline f64 lanes_min(f64 a, f64 b) { return (a < b)? a : b; }
+inline f64 lanes_select(bool mask, f64 a, f64 b) { return mask? a : b; }
+
+// variance of the samples of a child, see ucb_v and sp_mcts
+template<typename T>
+inline T sample_variance(T score, T squared, T n) {
+    T val = (score*score)/n;
+    T variance = (squared - val)/(n - T(1.0));
+    // for precision issues
+    variance = lanes_select(val > squared, T(0.0), variance);
+    return lanes_select(n == T(1.0), T(0.0), variance);
+}
+
+/*
+    The node_* functions as types, best_child and the tree policies are instantiated for each.
+    set_parent computes what only depends on the parent (log of its rollouts) once per selection step,
+    eval is the value of a child from its score sum, squared score sum and rollout count
+    for a single f64 or for F64x lanes (see best_child).
+    with_decision_policy picks the type of a Decision_Proc once per rollout,
+    other procedures (e.g. of experiments) go through Decision_Proc_Policy.
+*/
+struct Ucb1_Policy {
+    static constexpr bool batched = true;
+    f64 c2;
+    f64 log_n2;
+    force_inline void set_parent(Mcts_Node *parent) {
+        c2 = 2.0 * UCB1_C;
+        log_n2 = 2.0 * log(f64(atomic_load(&parent->rollout_count)));
+    }
+    template<typename T>
+    force_inline T eval(T score, T, T n) const {
+        T value = score/n + T(c2) * lanes_sqrt(T(log_n2)/n);
+        return lanes_select(n == T(0.0), T(F64_MAX), value);
+    }
+    force_inline f64 operator()(Mcts_Node *parent, Mcts_Node *node) const {
+        return node_ucb1(parent, node);
+    }
+};
+struct Ucb1_Tuned_Policy {
+    static constexpr bool batched = true;
+    f64 log_n;
+    force_inline void set_parent(Mcts_Node *parent) {
+        log_n = log(f64(atomic_load(&parent->rollout_count)));
+    }
+    template<typename T>
+    force_inline T eval(T score, T squared, T n) const {
+        T avrg = score/n;
+        T dif = T(log_n)/n;
+        T sqrt_d = lanes_sqrt(T(2.0) * dif);
+        T variance = (squared/n) - (avrg*avrg);
+        T right = lanes_sqrt(dif * lanes_min(T(0.25), sqrt_d + variance));
+        T value = avrg + T(2.0 * 4.0 * 1.0/SQRT2) * right;
+        return lanes_select(n == T(0.0), T(F64_MAX), value);
+    }
+    force_inline f64 operator()(Mcts_Node *parent, Mcts_Node *node) const {
+        return node_ucb1_tuned(parent, node);
+    }
+};
+struct Ucb_V_Policy {
+    static constexpr bool batched = true;
+    f64 epsilon2;
+    f64 right_scale;
+    force_inline void set_parent(Mcts_Node *parent) {
+        f64 epsilon = 1.0 * log(f64(atomic_load(&parent->rollout_count)));
+        epsilon2 = 2.0 * epsilon;
+        right_scale = (2.0 * 8.0 * 1.0/SQRT2) * (3.0 * epsilon * 1.4);
+    }
+    template<typename T>
+    force_inline T eval(T score, T squared, T n) const {
+        T variance = sample_variance(score, squared, n);
+        T left = lanes_sqrt((T(epsilon2) * variance) / n);
+        T value = score/n + left + T(right_scale) / n;
+        return lanes_select(n == T(0.0), T(F64_MAX), value);
+    }
+    force_inline f64 operator()(Mcts_Node *parent, Mcts_Node *node) const {
+        return node_ucb_v(parent, node);
+    }
+};
+struct Sp_Mcts_Policy {
+    static constexpr bool batched = true;
+    Ucb1_Policy ucb1;
+    f64 d;
+    force_inline void set_parent(Mcts_Node *parent) {
+        ucb1.set_parent(parent);
+        d = SP_MCTS_D;
+    }
+    template<typename T>
+    force_inline T eval(T score, T squared, T n) const {
+        T variance = sample_variance(score, squared, n);
+        T value = ucb1.eval(score, squared, n) + lanes_sqrt(variance + T(d)/n);
+        return lanes_select(n == T(0.0), T(F64_MAX), value);
+    }
+    force_inline f64 operator()(Mcts_Node *parent, Mcts_Node *node) const {
+        return node_sp_mcts(parent, node);
+    }
+};
+// Any other Decision_Proc, called per child
+struct Decision_Proc_Policy {
+    static constexpr bool batched = false;
+    Decision_Proc decision;
+    force_inline f64 operator()(Mcts_Node *parent, Mcts_Node *node) const {
+        return decision(parent, node);
+    }
+};
+
+// Calls proc with the policy of decision
+template<typename Proc>
+inline void with_decision_policy(const Decision_Proc decision, Proc proc) {
+    if(decision == node_ucb1_tuned) {
+        proc(Ucb1_Tuned_Policy{});
+    } else if(decision == node_ucb1) {
+        proc(Ucb1_Policy{});
+    } else if(decision == node_ucb_v) {
+        proc(Ucb_V_Policy{});
+    } else if(decision == node_sp_mcts) {
+        proc(Sp_Mcts_Policy{});
+    } else {
+        proc(Decision_Proc_Policy{decision});
+    }
+}
+
 #endif // USE_SQUARED_SUM
 
 #endif // UCT_ENHANCEMENTS
\ No newline at end of file
@@ -3,9 +3,6 @@
 
 u64 alloc_count = 0;
 u64 free_count = 0;
-Allocator *global_allocator = nullptr;
-Allocator *global_default_allocator = nullptr;
-Arena_Allocator *global_arena_allocator = nullptr;
 
 void _crash(const char *file_name, int line, const char *msg) {
 	println("\n-----------CRASH-----------");
@@ -154,13 +151,42 @@ bool approx(f64 a, f64 b) {
 #include <random>
 #include "settings.h"
 
-std::mt19937 g_random_engine(DEFAULT_SEED);
+// every thread gets its own engines; see Mcts::start
+thread_local std::mt19937 g_random_engine(DEFAULT_SEED);
+// constant initialized so that other translation units can access it without a tls wrapper
+thread_local Xoshiro256 g_xoshiro_engine = {{0x9e3779b97f4a7c15, 0xbf58476d1ce4e5b9, 0x94d049bb133111eb, 0x2545f4914f6cdd1d}};
+thread_local u32 g_rand_state = DEFAULT_SEED;
 
 void set_global_random_engine_seed(u64 seed) {
 	// ~g_random_engine();
 	g_random_engine = std::mt19937(seed);
+	g_xoshiro_engine.seed(seed);
+	g_rand_state = u32(seed);
+}
+Random_State get_random_state() {
+	return {g_random_engine, g_xoshiro_engine, g_rand_state};
+}
+void set_random_state(const Random_State &state) {
+	g_random_engine = state.mersenne;
+	g_xoshiro_engine = state.xoshiro;
+	g_rand_state = state.rand_state;
 }
 
+#if RANDOM_ENGINE == RANDOM_XOSHIRO
+// Random number in range [start, end)
+f64 randf_range(f64 start, f64 end) {
+	return start + g_xoshiro_engine.unit() * (end-start);
+}
+// Random number in range [start, end]
+i64 randi_range(i64 start, i64 end) {
+	u64 range = u64(end-start) + 1;
+	if(range <= U32_MAX) {
+		return start + g_xoshiro_engine.bounded(u32(range));
+	}
+	// only used for seeds; the modulo bias doesn't matter there
+	return start + i64(g_xoshiro_engine.next() % range);
+}
+#else // mersenne or rand
 // Random number in range [start, end)
 f64 randf_range(f64 start, f64 end) {
 	// std::random_device{}()
@@ -169,8 +195,7 @@ f64 randf_range(f64 start, f64 end) {
 	return r_range(g_random_engine);
 }
 
-
-#if MT_RANDOM == true
+#if RANDOM_ENGINE == RANDOM_MERSENNE
 // Random number in range [start, end]
 i64 randi_range(i64 start, i64 end) {
 	// static std::mt19937 r_engine(default_seed);
@@ -178,13 +203,20 @@ i64 randi_range(i64 start, i64 end) {
 	return r_range(g_random_engine);
 }
 #else
+// The generator of the rand example in the C standard but with the state of the thread
+// instead of the shared one of rand (which is a data race with threads)
+static inline i64 next_rand() {
+	g_rand_state = g_rand_state*1103515245 + 12345;
+	return i64((g_rand_state >> 16) & 0x7fff);
+}
 // Random number in range [0, end]
 i64 randi_range(i64 start, i64 end) {
 	// +1 for end]
 	// 7-0+1 = 8 for range [0, 8]
-	return start + i64(rand()) % (end-start+1);
+	return start + next_rand() % (end-start+1);
 }
-#endif
+#endif // RANDOM_ENGINE == RANDOM_MERSENNE
+#endif // RANDOM_ENGINE == RANDOM_XOSHIRO
 
 Chrono_Clock get_time() {
 	return std::chrono::system_clock::now();
@@ -192,3 +224,97 @@ Chrono_Clock get_time() {
 f64 time_diff(Chrono_Clock start, Chrono_Clock end) {
 	return std::chrono::duration<f64>(end-start).count();
 }
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+f64 get_process_cpu_time() {
+	FILETIME creation, exit, kernel, user;
+	if(!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+		return 0;
+	}
+	// 100ns units
+	auto to_u64 = [](FILETIME t) { return (u64(t.dwHighDateTime) << 32) | u64(t.dwLowDateTime); };
+	return f64(to_u64(kernel) + to_u64(user)) * 1e-7;
+}
+#else
+#include <sys/resource.h>
+f64 get_process_cpu_time() {
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	auto to_seconds = [](timeval t) { return f64(t.tv_sec) + f64(t.tv_usec) * 1e-6; };
+	return to_seconds(usage.ru_utime) + to_seconds(usage.ru_stime);
+}
+#endif // _WIN32
+
+inline u64 hash_set_key(u64 key) {
+	return key == 0 ? 1 : key;
+}
+bool Hash_Set::has(u64 key) {
+	if(count == 0) {
+		return false;
+	}
+	key = hash_set_key(key);
+	isize mask = capacity - 1;
+	for(isize i = key & mask; keys[i]; i = (i + 1) & mask) {
+		if(keys[i] == key) {
+			return true;
+		}
+	}
+	return false;
+}
+bool Hash_Set::add(u64 key) {
+	key = hash_set_key(key);
+	if(2*(count + 1) > capacity) {
+		// rehash into twice the size
+		Hash_Set grown;
+		grown.capacity = max<isize>(2*capacity, 64);
+		grown.keys = make_zeroed_array<u64>(grown.capacity);
+		for_range(i, 0, capacity) {
+			if(keys[i]) grown.add(keys[i]);
+		}
+		destroy();
+		*this = grown;
+	}
+	isize mask = capacity - 1;
+	isize i = key & mask;
+	for(; keys[i]; i = (i + 1) & mask) {
+		if(keys[i] == key) {
+			return false;
+		}
+	}
+	keys[i] = key;
+	count += 1;
+	return true;
+}
+// The following keys of the run are shifted back into the hole, there are no tombstones
+bool Hash_Set::remove(u64 key) {
+	if(count == 0) {
+		return false;
+	}
+	key = hash_set_key(key);
+	isize mask = capacity - 1;
+	isize i = key & mask;
+	for(; keys[i] != key; i = (i + 1) & mask) {
+		if(!keys[i]) {
+			return false;
+		}
+	}
+	for(isize j = (i + 1) & mask; keys[j]; j = (j + 1) & mask) {
+		isize home = keys[j] & mask;
+		// keys[j] may fill the hole if the hole lies between its home and j
+		if(((j - home) & mask) >= ((j - i) & mask)) {
+			keys[i] = keys[j];
+			i = j;
+		}
+	}
+	keys[i] = 0;
+	count -= 1;
+	return true;
+}
+void Hash_Set::destroy() {
+	if(keys) {
+		mem_free(keys);
+	}
+	*this = {};
+}
@@ -333,9 +333,222 @@ struct Byte_String {
 	void destroy();	
 };
 
+/*
+	Set of hashes (open addressing with linear probing), grows at half load.
+	0 marks an empty slot, so the key 0 is stored as 1.
+*/
+struct Hash_Set {
+	u64 *keys = nullptr;
+	isize capacity = 0; // power of 2
+	isize count = 0;
+	// returns false if the key is already in the set
+	bool add(u64);
+	bool has(u64);
+	// returns false if the key isn't in the set
+	bool remove(u64);
+	void destroy();
+};
+
+/*
+	Minimal atomics for sharing a tree between threads.
+	The structs stay trivially copyable which std::atomic isn't.
+*/
+#ifdef MSVC
+#include <intrin.h>
+#endif
+
+// Test and test-and-set spin lock
+struct Spin_Lock {
+	u8 flag = 0;
+	void lock() {
+		#ifdef MSVC
+		while(_InterlockedExchange8((char *)&flag, 1)) {
+			while(*(volatile u8 *)&flag) _mm_pause();
+		}
+		#else
+		while(__atomic_test_and_set(&flag, __ATOMIC_ACQUIRE)) {
+			while(__atomic_load_n(&flag, __ATOMIC_RELAXED)) {}
+		}
+		#endif
+	}
+	void unlock() {
+		#ifdef MSVC
+		_InterlockedExchange8((char *)&flag, 0);
+		#else
+		__atomic_clear(&flag, __ATOMIC_RELEASE);
+		#endif
+	}
+};
+
+// Relaxed loads are plain loads on x86, so these don't cost anything for a single thread.
+inline i32 atomic_load(const i32 *ptr) {
+	#ifdef MSVC
+	return *(const volatile i32 *)ptr;
+	#else
+	return __atomic_load_n(ptr, __ATOMIC_RELAXED);
+	#endif
+}
+inline f64 atomic_load(const f64 *ptr) {
+	#ifdef MSVC
+	return *(const volatile f64 *)ptr;
+	#else
+	f64 value;
+	__atomic_load(ptr, &value, __ATOMIC_RELAXED);
+	return value;
+	#endif
+}
+// returns the previous value
+inline i64 atomic_fetch_add(i64 *ptr, i64 value) {
+	#ifdef MSVC
+	return _InterlockedExchangeAdd64((volatile i64 *)ptr, value);
+	#else
+	return __atomic_fetch_add(ptr, value, __ATOMIC_RELAXED);
+	#endif
+}
+inline void atomic_add(i32 *ptr, i32 value) {
+	#ifdef MSVC
+	_InterlockedExchangeAdd((long *)ptr, value);
+	#else
+	__atomic_fetch_add(ptr, value, __ATOMIC_RELAXED);
+	#endif
+}
+// compare and swap loop since there is no fetch_add for floating point numbers
+inline void atomic_add(f64 *ptr, f64 value) {
+	#ifdef MSVC
+	i64 expected = *(volatile i64 *)ptr;
+	while(true) {
+		f64 old_value, new_value;
+		memcpy(&old_value, &expected, sizeof(f64));
+		new_value = old_value + value;
+		i64 desired;
+		memcpy(&desired, &new_value, sizeof(f64));
+		i64 previous = _InterlockedCompareExchange64((volatile i64 *)ptr, desired, expected);
+		if(previous == expected) break;
+		expected = previous;
+	}
+	#else
+	f64 expected, desired;
+	__atomic_load(ptr, &expected, __ATOMIC_RELAXED);
+	do {
+		desired = expected + value;
+	} while(!__atomic_compare_exchange(ptr, &expected, &desired, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	#endif
+}
+// Acquire/release for handing data from one thread to another (see Level_Queue).
+// x86 doesn't reorder these, msvc only needs to be kept from doing it.
+inline i64 atomic_load_acquire(const i64 *ptr) {
+	#ifdef MSVC
+	i64 value = *(const volatile i64 *)ptr;
+	_ReadWriteBarrier();
+	return value;
+	#else
+	return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+	#endif
+}
+inline void atomic_store_release(i64 *ptr, i64 value) {
+	#ifdef MSVC
+	_ReadWriteBarrier();
+	*(volatile i64 *)ptr = value;
+	#else
+	__atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+	#endif
+}
+
+// Bit helpers
+inline i32 popcount(u64 value) {
+	#ifdef MSVC
+	return (i32)__popcnt64(value);
+	#else
+	return __builtin_popcountll(value);
+	#endif
+}
+// value must not be 0
+inline i32 count_trailing_zeros(u64 value) {
+	#ifdef MSVC
+	unsigned long index;
+	_BitScanForward64(&index, value);
+	return (i32)index;
+	#else
+	return __builtin_ctzll(value);
+	#endif
+}
+// floor(log2(value)); value must not be 0
+inline i32 log2_floor(u64 value) {
+	#ifdef MSVC
+	unsigned long index;
+	_BitScanReverse64(&index, value);
+	return (i32)index;
+	#else
+	return 63 - __builtin_clzll(value);
+	#endif
+}
+
 #include <random>
-extern std::mt19937 g_random_engine;
+/*
+	xoshiro256** by Blackman and Vigna (https://prng.di.unimi.it/)
+	The state is only 32 bytes and a number costs a few shifts and multiplications.
+*/
+struct Xoshiro256 {
+	u64 state[4];
+
+	static force_inline u64 rotl(u64 x, int k) {
+		return (x << k) | (x >> (64 - k));
+	}
+	// fills the state with splitmix64 so that similar seeds give unrelated states
+	void seed(u64 seed) {
+		for_range(i, 0, 4) {
+			seed += 0x9e3779b97f4a7c15;
+			u64 z = seed;
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+			state[i] = z ^ (z >> 31);
+		}
+	}
+	force_inline u64 next() {
+		u64 result = rotl(state[1] * 5, 7) * 9;
+		u64 t = state[1] << 17;
+		state[2] ^= state[0];
+		state[3] ^= state[1];
+		state[1] ^= state[2];
+		state[0] ^= state[3];
+		state[2] ^= t;
+		state[3] = rotl(state[3], 45);
+		return result;
+	}
+	// Random number in range [0, n) without modulo bias (Lemire's multiply and reject)
+	force_inline u32 bounded(u32 n) {
+		u64 m = (next() >> 32) * u64(n);
+		u32 low = u32(m);
+		if(low < n) {
+			u32 threshold = u32(-n) % n;
+			while(low < threshold) {
+				m = (next() >> 32) * u64(n);
+				low = u32(m);
+			}
+		}
+		return u32(m >> 32);
+	}
+	// Random number in range [0, 1)
+	force_inline f64 unit() {
+		return f64(next() >> 11) * 0x1.0p-53;
+	}
+};
+
+// every thread gets its own engines; see Mcts::start
+extern thread_local std::mt19937 g_random_engine;
+extern thread_local Xoshiro256 g_xoshiro_engine;
+// state of the rand like engine of RANDOM_RAND
+extern thread_local u32 g_rand_state;
+// seeds the engines of the calling thread
 void set_global_random_engine_seed(u64);
+// Both engines of a thread, e.g. to continue a search from a checkpoint with the same numbers
+struct Random_State {
+	std::mt19937 mersenne;
+	Xoshiro256 xoshiro;
+	u32 rand_state;
+};
+Random_State get_random_state();
+void set_random_state(const Random_State &);
 f64 randf_range(f64, f64);
 i64 randi_range(i64, i64);
 
@@ -402,5 +615,7 @@ bool approx(f64, f64);
 typedef std::chrono::time_point<std::chrono::system_clock> Chrono_Clock;
 Chrono_Clock get_time();
 f64 time_diff(Chrono_Clock start, Chrono_Clock end);
+// CPU time of all threads of the process so far in seconds
+f64 get_process_cpu_time();
 
 #endif // UTIL_H